@@ -2,411 +2,6861 @@
 
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <map>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <iostream>
 #include <filesystem>
+#include <algorithm>
+#include <optional>
+#include <cmath>
+#include <cctype>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <array>
+#include <memory>
+#include <memory_resource>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <fstream>
+#include <regex>
+#include <atomic>
+#include <limits>
+#include <chrono>
+#include <bitset>
+#include <charconv>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TMXTOSDL_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #include "rapidxml/rapidxml.hpp"
-#include "rapidxml/rapidxml_utils.hpp"
 
 #include "SDL.h"
 #include "SDL_image.h"
 
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
 namespace TMXtoSDL
 {
 
     using Collider = SDL_Rect;
-    using ColliderList = std::vector<Collider>;
+    using ColliderList = std::pmr::vector<Collider>;
+    using ColliderMap = std::pmr::map<int, ColliderList>;
     
 
     /// 
-    ///  TILESET DATA CONTAINING TEXTURE AND TILE DATA
+    ///  LOAD PROFILING WITH CHROME TRACE EXPORT
     /// 
 
-    struct TilesetData
+    // Records scoped events from every thread and writes them in the Chrome trace event format, viewable in
+    // chrome://tracing or Perfetto. Scopes are only recorded when TMXTOSDL_PROFILE is defined before including
+    // this header; otherwise the macros below compile to nothing.
+    class Profiler
     {
-        int firstID;
-        SDL_Texture* tilesetTex;
-        int tileWidth;
-        int tileHeight;
-        int tilesetWidth;
-
-        TilesetData() = default;
-        TilesetData(int id, SDL_Texture* tex, int w, int h, int setW)
-            : firstID(id), tilesetTex(tex), tileWidth(w), tileHeight(h), tilesetWidth(setW) {}
+    public:
+        struct Event
+        {
+            const char* name;
+            double start;       // Microseconds since the profiler epoch
+            double duration;
+            uint32_t thread;
+            int64_t bytes;      // -1 if not set
+            int64_t tiles;
+        };
 
-        bool operator <(const TilesetData& other) const
+        static Profiler& Get()
         {
-            return firstID < other.firstID;
+            static Profiler profiler;
+            return profiler;
         }
-    };
 
+        double Now() const { return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - mEpoch).count(); }
 
-    /// 
-    ///  SDL TEXTURE FUNCTIONS
-    /// 
-	
-	class Image 
-	{
-	private:
-		static SDL_Texture* LoadTex(const char* filename, SDL_Renderer* renderer)
-		{
-			SDL_Texture* tex = nullptr;
-			
-			SDL_Surface* tempSurface = IMG_Load(filename);
-			if (!tempSurface) { std::cout << "Could not load textures." << std::endl; return nullptr; }
-			
-			tex = SDL_CreateTextureFromSurface(renderer, tempSurface);
-			if (!tex) { std::cout << SDL_GetError() << std::endl; SDL_FreeSurface(tempSurface); return nullptr; }
-			
-			SDL_FreeSurface(tempSurface);
-			return tex;
-		}
+        // Small sequential ID for the calling thread, used as its track in the trace
+        static uint32_t ThreadID()
+        {
+            static std::atomic<uint32_t> nextID{ 1 };
+            thread_local uint32_t id = nextID++;
+            return id;
+        }
 
-    public:
-        static void DestroyTilesets(std::vector<TilesetData>& tilesets)
+        void Record(const Event& event)
         {
-            for (auto& tileset : tilesets)
-                SDL_DestroyTexture(tileset.tilesetTex);
+            std::lock_guard<std::mutex> lock(mMutex);
+            mEvents.push_back(event);
         }
 
-        static void DestroyTex(SDL_Texture* tex) { SDL_DestroyTexture(tex); }
-        static void DestroyTex(TilesetData& tileset) { SDL_DestroyTexture(tileset.tilesetTex); }
-	};
+        void Clear()
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mEvents.clear();
+        }
 
+        // Returns false if the file can't be written
+        bool WriteTrace(const std::filesystem::path& path) const
+        {
+            std::ofstream file(path);
+            if (!file) return false;
 
+            std::lock_guard<std::mutex> lock(mMutex);
 
-    /// 
-    ///  LAYER CLASS CONTAINING TILE IDS
-    ///
+            std::vector<uint32_t> threads;
+            file << "{\"traceEvents\":[\n";
+            for (size_t i = 0; i < mEvents.size(); i++)
+            {
+                const Event& event = mEvents[i];
+                if (std::find(threads.begin(), threads.end(), event.thread) == threads.end()) threads.push_back(event.thread);
 
-    class Layer
-    {
-    public:
-        Layer(size_t width, size_t height)
-            : mWidth(width), mHeight(height)
-        {
-            mElements.reserve(width * height);
+                file << "{\"name\":\"" << event.name << "\",\"cat\":\"TMXtoSDL\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+                    << ",\"ts\":" << event.start << ",\"dur\":" << event.duration << ",\"args\":{";
+                if (event.bytes >= 0) file << "\"bytes\":" << event.bytes << (event.tiles >= 0 ? "," : "");
+                if (event.tiles >= 0) file << "\"tiles\":" << event.tiles;
+                file << "}},\n";
+            }
+
+            //Name each thread's track
+            for (size_t i = 0; i < threads.size(); i++)
+            {
+                file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threads[i]
+                    << ",\"args\":{\"name\":\"Loader thread " << threads[i] << "\"}}" << (i + 1 < threads.size() ? ",\n" : "\n");
+            }
+            file << "]}\n";
+            return static_cast<bool>(file);
         }
 
-        // This function clears the layer of any existing values
-        void resize(size_t width, size_t height)
-        {
-            mElements.clear();
-            mElements.reserve(width * height);
+    private:
+        Profiler() : mEpoch(std::chrono::steady_clock::now()) {}
 
-            mWidth = width;
-            mHeight = height;
-        }
+    private:
+        std::chrono::steady_clock::time_point mEpoch;
+        std::vector<Event> mEvents;
+        mutable std::mutex mMutex;
+    };
 
-        size_t getWidth() const { return mWidth; }
-        size_t getHeight() const { return mHeight; }
+    class ProfileScope
+    {
+    public:
+        explicit ProfileScope(const char* name)
+            : mEvent{ name, Profiler::Get().Now(), 0.0, Profiler::ThreadID(), -1, -1 } {}
 
-        std::vector<int> getRow(size_t row)
+        ~ProfileScope()
         {
-            const auto start = mElements.begin() + (row * mWidth);
-            return std::vector<int>(start, start + mWidth);
+            mEvent.duration = Profiler::Get().Now() - mEvent.start;
+            Profiler::Get().Record(mEvent);
         }
 
-        void push_back(int element) { mElements.push_back(element); }
-
-        void clear() { mElements.clear(); }
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
 
-        int& operator()(size_t x, size_t y) { return mElements[(mWidth * y) + x]; }
-        const int& operator()(size_t x, size_t y) const { return mElements[(mWidth * y) + x]; }
+        void SetBytes(size_t bytes) { mEvent.bytes = static_cast<int64_t>(bytes); }
+        void SetTiles(size_t tiles) { mEvent.tiles = static_cast<int64_t>(tiles); }
 
     private:
-        std::vector<int> mElements;
-        size_t mWidth;
-        size_t mHeight;
+        Profiler::Event mEvent;
     };
 
+#ifdef TMXTOSDL_PROFILE
+    // One scope per block. The byte and tile macros annotate the innermost scope.
+    #define TMXTOSDL_PROFILE_SCOPE(name) ::TMXtoSDL::ProfileScope tmxProfileScope(name)
+    #define TMXTOSDL_PROFILE_BYTES(bytes) tmxProfileScope.SetBytes(bytes)
+    #define TMXTOSDL_PROFILE_TILES(tiles) tmxProfileScope.SetTiles(tiles)
+#else
+    #define TMXTOSDL_PROFILE_SCOPE(name) ((void)0)
+    #define TMXTOSDL_PROFILE_BYTES(bytes) ((void)0)
+    #define TMXTOSDL_PROFILE_TILES(tiles) ((void)0)
+#endif
+
 
     /// 
-    ///  XML ATTRIBUTE ENUM
+    ///  MEMORY ACCOUNTING
     /// 
 
-    enum class Attribute
+    // Heap bytes owned by standard containers, used for memory reports. Node sizes are estimates
+    // since the exact layout depends on the standard library.
+    template<typename T, typename Allocator>
+    size_t VectorBytes(const std::vector<T, Allocator>& vector) { return vector.capacity() * sizeof(T); }
+
+    // Strings short enough for the small string buffer own no heap memory
+    template<typename Allocator>
+    size_t StringBytes(const std::basic_string<char, std::char_traits<char>, Allocator>& string)
     {
-        X,
-        Y,
-        Width,
-        Height
-    };
+        return string.capacity() >= sizeof(string) - 1 ? string.capacity() + 1 : 0;
+    }
 
+    template<typename Map>
+    size_t HashMapBytes(const Map& map) { return (map.bucket_count() * sizeof(void*)) + (map.size() * (sizeof(typename Map::value_type) + (2 * sizeof(void*)))); }
 
-    /// 
-    ///  ATTRIBUTE STRING TO ENUM LOOKUP TABLE
-    /// 
+    template<typename Map>
+    size_t TreeMapBytes(const Map& map) { return map.size() * (sizeof(typename Map::value_type) + (4 * sizeof(void*))); }
 
-    static const std::unordered_map<std::string, Attribute> AttributeTable =
+    // Transient bytes held by the load running on the calling thread: file buffers, XML node pools and
+    // decoded images waiting to be uploaded. OpenMap resets it and copies the peak into LoadStats.
+    struct LoadMemory
     {
-        {"x", Attribute::X},
-        {"y", Attribute::Y},
-        {"width", Attribute::Width},
-        {"height", Attribute::Height}
+        size_t current = 0;
+        size_t peak = 0;
+
+        void Add(size_t bytes) { current += bytes; peak = std::max(peak, current); }
+        void Remove(size_t bytes) { current -= std::min(current, bytes); }
+
+        static LoadMemory& Get()
+        {
+            thread_local LoadMemory memory;
+            return memory;
+        }
     };
 
+
     /// 
-    ///  FILE IO INTERFACE. EXTRACTS TILEMAP DATA FROM .TMX FILE
+    ///  REUSABLE XML DOCUMENTS
     /// 
 
-    class IO
+    // Documents are parsed without writing into the file buffer and without expanding entities, so names and values
+    // are not null terminated. Read strings through NameOf and ValueOf, and pass strings that are kept through
+    // UnescapeXml. Numbers can still be read with atoi and strtof since every value is followed by a quote or '<'.
+    constexpr int XmlParseFlags = rapidxml::parse_non_destructive | rapidxml::parse_no_data_nodes;
+
+    inline std::string_view NameOf(const rapidxml::xml_base<>* base) { return std::string_view(base->name(), base->name_size()); }
+    inline std::string_view ValueOf(const rapidxml::xml_base<>* base) { return std::string_view(base->value(), base->value_size()); }
+
+    // Expands the predefined entities and numeric character references in text. Returns text itself if it
+    // has none, otherwise a view of buffer.
+    inline std::string_view UnescapeXml(std::string_view text, std::string& buffer)
+    {
+        size_t next = text.find('&');
+        if (next == std::string_view::npos) return text;
+
+        buffer.assign(text.data(), next);
+        for (size_t i = next; i < text.size(); i++)
+        {
+            size_t end = text[i] == '&' ? text.find(';', i) : std::string_view::npos;
+            if (end == std::string_view::npos) { buffer += text[i]; continue; }
+
+            std::string_view entity = text.substr(i + 1, end - i - 1);
+            if (entity == "amp") buffer += '&';
+            else if (entity == "lt") buffer += '<';
+            else if (entity == "gt") buffer += '>';
+            else if (entity == "quot") buffer += '"';
+            else if (entity == "apos") buffer += '\'';
+            else if (entity.size() > 1 && entity[0] == '#')
+            {
+                bool hex = entity[1] == 'x' || entity[1] == 'X';
+                uint32_t code = static_cast<uint32_t>(std::strtoul(std::string(entity.substr(hex ? 2 : 1)).c_str(), nullptr, hex ? 16 : 10));
+
+                //Encode the code point as UTF-8
+                if (code < 0x80) buffer += static_cast<char>(code);
+                else if (code < 0x800) { buffer += static_cast<char>(0xC0 | (code >> 6)); buffer += static_cast<char>(0x80 | (code & 0x3F)); }
+                else if (code < 0x10000) { buffer += static_cast<char>(0xE0 | (code >> 12)); buffer += static_cast<char>(0x80 | ((code >> 6) & 0x3F)); buffer += static_cast<char>(0x80 | (code & 0x3F)); }
+                else { buffer += static_cast<char>(0xF0 | (code >> 18)); buffer += static_cast<char>(0x80 | ((code >> 12) & 0x3F)); buffer += static_cast<char>(0x80 | ((code >> 6) & 0x3F)); buffer += static_cast<char>(0x80 | (code & 0x3F)); }
+            }
+            else
+            {
+                buffer += text[i];
+                continue;
+            }
+            i = end;
+        }
+        return buffer;
+    }
+
+    // Pool blocks and file buffers above this are freed instead of kept for the next document
+    constexpr size_t MaxCachedXmlBytes = 16 * 1024 * 1024;
+
+    // Free list of parsed documents and their file buffers. Each Loader owns one, and documents created without a
+    // pool share one per thread. Thread safe.
+    class XmlDocumentPool
     {
     public:
-        static void SetRenderer(SDL_Renderer* renderer) { mCurrentRenderer = renderer; }
-        static void OpenLevel(const std::filesystem::path& lvlPath, std::vector<Layer>& layerList, std::vector<TilesetData>& tilesetData, std::map<int, ColliderList>& tilesetColliders, SDL_Renderer* renderer = nullptr);
+        XmlDocumentPool() = default;
+        XmlDocumentPool(const XmlDocumentPool&) = delete;
+        XmlDocumentPool& operator=(const XmlDocumentPool&) = delete;
+
+        static XmlDocumentPool& ForThread()
+        {
+            thread_local XmlDocumentPool pool;
+            return pool;
+        }
 
     private:
-        static void GetLayers(rapidxml::xml_node<>* mapNode, std::vector<Layer>& layerList);
-        static void GetTilesets(rapidxml::xml_node<>* mapNode, const std::filesystem::path& lvlPath, std::vector<TilesetData>& setData, std::map<int, ColliderList>& tilesetColliders);
-        static void GetTileData(const std::filesystem::path& tileset, int firstID, std::vector<TilesetData>& setData, std::map<int, ColliderList>& tilesetColliders);
-        static void GetTileData(rapidxml::xml_node<>* tilesetNode, int firstID, const std::filesystem::path& pngPath, std::vector<TilesetData>& setData, std::map<int, ColliderList>& tilesetColliders);
+        friend class XmlDocument;
+
+        struct Entry
+        {
+            rapidxml::xml_document<> document;
+            std::vector<char> buffer;
+        };
+
+        std::unique_ptr<Entry> Take()
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mFree.empty()) return nullptr;
+
+            std::unique_ptr<Entry> entry = std::move(mFree.back());
+            mFree.pop_back();
+            return entry;
+        }
 
-        static rapidxml::xml_node<>* GetChild(rapidxml::xml_node<>* inputNode, std::string sNodeFilter);
-        static ColliderList GetColliders(rapidxml::xml_node<>* inputNode);
+        void Return(std::unique_ptr<Entry> entry)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mFree.push_back(std::move(entry));
+        }
 
     private:
-        static SDL_Renderer* mCurrentRenderer;
+        std::vector<std::unique_ptr<Entry>> mFree;
+        std::mutex mMutex;
     };
 
-    rapidxml::xml_node<>* IO::GetChild(rapidxml::xml_node<>* inputNode, std::string sNodeFilter)
+    // A file and its parsed tree, leased from a pool. Returning the lease keeps the file buffer's capacity and the
+    // document's static pool, and the dynamic pool blocks it frees are cached for the next document on the same
+    // thread, so loads after the first allocate next to nothing for XML. Several leases can be held at once, e.g. a
+    // map and one of its external tilesets.
+    class XmlDocument
     {
-        // cycles every child
-        for (rapidxml::xml_node<>* nodeChild = inputNode->first_node(); nodeChild; nodeChild = nodeChild->next_sibling())
+    public:
+        explicit XmlDocument(XmlDocumentPool& pool = XmlDocumentPool::ForThread())
+            : mPool(pool), mEntry(pool.Take())
         {
-            if (nodeChild->name() == sNodeFilter)
+            if (!mEntry)
             {
-                // returns the desired child
-                return nodeChild;
+                mEntry = std::make_unique<Entry>();
+                mEntry->document.set_allocator(Allocate, Free);
             }
-            rapidxml::xml_node<>* x = GetChild(nodeChild, sNodeFilter);
-            if (x)
-                return x;
+            LoadMemory::Get().Add(sizeof(Entry));
         }
-        return 0;
-    }
 
-    void IO::GetLayers(rapidxml::xml_node<>* mapNode, std::vector<Layer>& layerList)
-    {
-        int layerCount = 0;
-        for (rapidxml::xml_node<>* layer = GetChild(mapNode, "layer"); layer; layer = layer->next_sibling())
+        ~XmlDocument()
         {
-            layerCount++;
+            //Pool blocks go to the block cache, so the document in the free list holds only its static pool
+            mEntry->document.clear();
+            LoadMemory::Get().Remove(sizeof(Entry) + mSize);
+
+            if (mEntry->buffer.capacity() > MaxCachedXmlBytes) std::vector<char>().swap(mEntry->buffer);
+            mPool.Return(std::move(mEntry));
         }
 
-        layerList.reserve(layerCount);
+        XmlDocument(const XmlDocument&) = delete;
+        XmlDocument& operator=(const XmlDocument&) = delete;
+
+        // Reads a whole file into the buffer and returns its size. Throws std::runtime_error if it can't be read.
+        size_t Read(const std::filesystem::path& path)
+        {
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if (!file) throw std::runtime_error("cannot open file " + path.string());
+
+            LoadMemory::Get().Remove(mSize);
+            mSize = static_cast<size_t>(file.tellg());
+            mEntry->buffer.resize(mSize + 1);
+            file.seekg(0);
+            if (!file.read(mEntry->buffer.data(), static_cast<std::streamsize>(mSize))) throw std::runtime_error("cannot read file " + path.string());
+            mEntry->buffer[mSize] = '\0';
+            LoadMemory::Get().Add(mSize);
+            return mSize;
+        }
 
-        rapidxml::xml_node<>* layerMetaData = GetChild(mapNode, "layer");
+        // Copies text into the buffer instead of reading a file
+        void Assign(std::string_view text)
+        {
+            LoadMemory::Get().Remove(mSize);
+            mSize = text.size();
+            mEntry->buffer.assign(text.begin(), text.end());
+            mEntry->buffer.push_back('\0');
+            LoadMemory::Get().Add(mSize);
+        }
 
-        int width = std::atoi(layerMetaData->first_attribute("width")->value());
-        int height = std::atoi(layerMetaData->first_attribute("height")->value());
+        void Parse()
+        {
+            mEntry->document.clear();
+            mEntry->document.parse<XmlParseFlags>(mEntry->buffer.data());
+        }
 
-        Layer currLayer(width, height);
+        rapidxml::xml_node<>* FirstNode(const char* name = nullptr) const { return mEntry->document.first_node(name); }
+        size_t GetSize() const { return mSize; }
 
-        std::string mapLine;
-        std::string mapElement;
+    private:
+        using Entry = XmlDocumentPool::Entry;
 
-        for (rapidxml::xml_node<>* layer = GetChild(mapNode, "layer"); layer; layer = layer->next_sibling())
+        // The rapidxml allocator hooks take no context, so freed pool blocks are cached per thread
+        struct BlockCache
         {
-            rapidxml::xml_node<>* layerData = GetChild(layer, "data");
-            std::istringstream mapStream(layerData->value());
+            std::vector<char*> blocks;
+            size_t bytes = 0;
 
-            //Data begins with CRLF so read this first to ignore it.
-            std::getline(mapStream, mapLine);
+            ~BlockCache()
+            {
+                for (char* block : blocks) ::operator delete(block);
+            }
+        };
+
+        static BlockCache& Blocks()
+        {
+            thread_local BlockCache cache;
+            return cache;
+        }
 
-            while (std::getline(mapStream, mapLine))
+        // rapidxml allocator hooks. The size of each block is stored in front of it because the free hook
+        // only gets the pointer. Blocks handed to a document count towards LoadMemory.
+        static void* Allocate(std::size_t size)
+        {
+            BlockCache& cache = Blocks();
+            char* block = nullptr;
+            for (size_t i = cache.blocks.size(); i-- > 0;)
             {
-                std::istringstream lineStream(mapLine);
-                while (std::getline(lineStream, mapElement, ','))
+                if (*reinterpret_cast<size_t*>(cache.blocks[i]) >= size)
                 {
-                    if (mapElement != "\r" && mapElement != "\n")
-                    {
-                        currLayer.push_back(std::stoi(mapElement));
-                    }
+                    block = cache.blocks[i];
+                    cache.blocks.erase(cache.blocks.begin() + i);
+                    cache.bytes -= *reinterpret_cast<size_t*>(block);
+                    break;
                 }
             }
-            layerList.emplace_back(std::move(currLayer));
-            currLayer.clear();
-        }
-    }
-
-    void IO::GetTileData(const std::filesystem::path& tileset, int firstID, std::vector<TilesetData>& setData, std::map<int, ColliderList>& tilesetColliders)
-    {
-        std::string tilesetTmx = "levels/l";
-
-        //Remove .tsx extension and replace with .png
-        std::filesystem::path tilesetPng = tileset.stem();
-        tilesetPng += ".png";
 
-        //Get initial node
-        rapidxml::file<> xmlFile(tileset.string().c_str());
-        rapidxml::xml_document<>* doc = new rapidxml::xml_document<>;
-        doc->parse<0>(xmlFile.data());
-        rapidxml::xml_node<>* parent = doc->first_node();
-
-        //Build data struct for this tileset 
-        SDL_Texture* tilesetTex = Image::LoadTex(tilesetPng.string().c_str(), mCurrentRenderer);
-        int tileWidth = std::atoi(parent->first_attribute("tilewidth")->value());
-        int tileHeight = std::atoi(parent->first_attribute("tileheight")->value());
-        int tilesetWidth = std::atoi(parent->first_attribute("columns")->value());
+            if (!block)
+            {
+                block = static_cast<char*>(::operator new(size + sizeof(std::max_align_t)));
+                *reinterpret_cast<size_t*>(block) = size;
+            }
 
-        setData.emplace_back(firstID, tilesetTex, tileWidth, tileHeight, tilesetWidth);
+            LoadMemory::Get().Add(*reinterpret_cast<size_t*>(block));
+            return block + sizeof(std::max_align_t);
+        }
 
-        //Build list of colliders for each tileID
-        for (rapidxml::xml_node<>* tile = GetChild(parent, "tile"); tile; tile = tile->next_sibling())
+        static void Free(void* pointer)
         {
-            if (GetChild(tile, "objectgroup"))
+            char* block = static_cast<char*>(pointer) - sizeof(std::max_align_t);
+            size_t size = *reinterpret_cast<size_t*>(block);
+            LoadMemory::Get().Remove(size);
+
+            BlockCache& cache = Blocks();
+            if (cache.bytes + size > MaxCachedXmlBytes)
             {
-                //Add key value pair for this tile ID
-                int tileID = std::atoi(tile->first_attribute()->value());
-                tilesetColliders.emplace(firstID + tileID, GetColliders(tile));
+                ::operator delete(block);
+                return;
             }
+            cache.blocks.push_back(block);
+            cache.bytes += size;
         }
 
-        delete doc;
-        doc = nullptr;
-    }
+    private:
+        XmlDocumentPool& mPool;
+        std::unique_ptr<Entry> mEntry;
+        size_t mSize = 0;
+    };
+
+
+    /// 
+    ///  TYPED CUSTOM PROPERTIES WITH INTERNED KEYS
+    /// 
 
-    void IO::GetTileData(rapidxml::xml_node<>* tilesetNode, int firstID, const std::filesystem::path& pngPath, std::vector<TilesetData>& setData, std::map<int, ColliderList>& tilesetColliders)
+    enum class PropertyType : uint8_t
     {
-        int tileWidth = std::atoi(tilesetNode->first_attribute("tilewidth")->value());
-        int tileHeight = std::atoi(tilesetNode->first_attribute("tileheight")->value());
-        int tilesetWidth = std::atoi(tilesetNode->first_attribute("columns")->value());
-        std::filesystem::path tilesetPath = pngPath;
-        tilesetPath += std::filesystem::path(GetChild(tilesetNode, "image")->first_attribute("source")->value());
-        SDL_Texture* tilesetTex = Image::LoadTex(tilesetPath.string().c_str(), mCurrentRenderer);
+        Int,
+        Float,
+        Bool,
+        Color,
+        String,
+        File,
+        Object
+    };
 
-        setData.emplace_back(firstID, tilesetTex, tileWidth, tileHeight, tilesetWidth);
+    using PropertyKey = uint32_t;
 
-        for (rapidxml::xml_node<>* tile = GetChild(tilesetNode, "tile"); tile; tile = tile->next_sibling())
+    // Index of a set of properties in a PropertyTable. Set 0 is always empty.
+    using PropertySet = uint32_t;
+
+    // FNV-1a hash of a property name. Usable at compile time, so query keys can be pre-hashed:
+    //     static constexpr PropertyKey kHealth = HashProperty("health");
+    constexpr PropertyKey HashProperty(std::string_view name)
+    {
+        uint32_t hash = 2166136261u;
+        for (char c : name)
         {
-            int tileID = std::atoi(tile->first_attribute("id")->value());
-            tilesetColliders.emplace(firstID + tileID, GetColliders(tile));
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 16777619u;
         }
-
+        return hash;
     }
 
-    void IO::GetTilesets(rapidxml::xml_node<>* mapNode, const std::filesystem::path& lvlPath, std::vector<TilesetData>& setData, std::map<int, ColliderList>& tilesetColliders)
+    struct Property
     {
-        for (rapidxml::xml_node<>* tileset = GetChild(mapNode, "tileset"); std::string(tileset->name()) == "tileset"; tileset = tileset->next_sibling())
+        PropertyKey key;
+        PropertyType type;
+        union
         {
-            int firstGridID = std::atoi(tileset->first_attribute("firstgid")->value());
+            int32_t intValue;       // Int and Object (object id)
+            float floatValue;
+            bool boolValue;
+            uint32_t colorValue;    // 0xAARRGGBB
+            uint32_t stringIndex;   // String and File, index into the table's string pool
+        };
+    };
 
-            //Some tilesets are included inline in file, some stored externally. 
-            if (rapidxml::xml_attribute<>* source = tileset->first_attribute("source"))
-            {
-                std::filesystem::path tilesetPath = lvlPath;
-                tilesetPath += std::filesystem::path(source->value());
-                GetTileData(tilesetPath, firstGridID, setData, tilesetColliders);
-            }
-            else
+    class PropertyTable
+    {
+    public:
+        PropertyTable() { mSets.push_back({ 0, 0 }); }
+
+        // Starts a new set, reusing the handle of a released one if there is one. Properties added with add() go into
+        // the most recently opened set.
+        PropertySet openSet()
+        {
+            if (!mFreeSets.empty())
             {
-                GetTileData(tileset, firstGridID, lvlPath, setData, tilesetColliders);
+                mOpenSet = mFreeSets.back();
+                mFreeSets.pop_back();
+                mSets[mOpenSet] = { static_cast<uint32_t>(mProperties.size()), 0 };
+                return mOpenSet;
             }
+
+            mSets.push_back({ static_cast<uint32_t>(mProperties.size()), 0 });
+            mOpenSet = static_cast<PropertySet>(mSets.size() - 1);
+            return mOpenSet;
         }
 
-        std::sort(setData.begin(), setData.end());
-    }
+        // Empties a set that is no longer used, such as one replaced by a hot reload, and frees its handle for reuse.
+        // Release each set once. The table is compacted once more of it is released than in use, which closes the
+        // open set and invalidates property pointers and string views.
+        void releaseSet(PropertySet set)
+        {
+            if (set == 0 || set >= mSets.size()) return;
 
-    ColliderList IO::GetColliders(rapidxml::xml_node<>* inputNode)
-    {
-        //Initialise vector to return
-        ColliderList returnColliders;
+            for (const Property* it = begin(set); it != end(set); ++it)
+                mIndex.erase(IndexKey(set, it->key));
+            mReleased += mSets[set].second;
+            mSets[set] = { 0, 0 };
+            mFreeSets.push_back(set);
+            if (set == mOpenSet) mOpenSet = 0;
 
-        // cycles every collider in group
-        for (rapidxml::xml_node<>* collider = GetChild(inputNode, "object"); collider; collider = collider->next_sibling())
+            if (mReleased > 64 && mReleased > mProperties.size() / 2) compact();
+        }
+
+        // Parses value according to its Tiled type name ("int", "float", "bool", "color", "file", "object", or "string" if empty).
+        // Throws if name has the same hash as a different name already in the table.
+        void add(PropertySet set, std::string_view name, std::string_view type, std::string_view value)
         {
-            int x = 0, y = 0, w = 0, h = 0;
-            std::string attrName;
+            if (set == 0 || set != mOpenSet) return;
 
-            // Cycles every attribute of the collider
-            for (rapidxml::xml_attribute<>* nodeAttr = collider->first_attribute("x"); nodeAttr; nodeAttr = nodeAttr->next_attribute())
-            {
-                attrName = nodeAttr->name();
-                double fAttr = std::atof(nodeAttr->value());
-                int attr = static_cast<int>(round(fAttr));
+            Property property;
+            property.key = internKey(name);
+            property.intValue = 0;
 
-                if (AttributeTable.count(attrName) == 0) continue;
+            std::string valueStr(value);
+            if (type == "int") { property.type = PropertyType::Int; property.intValue = std::atoi(valueStr.c_str()); }
+            else if (type == "float") { property.type = PropertyType::Float; property.floatValue = std::strtof(valueStr.c_str(), nullptr); }
+            else if (type == "bool") { property.type = PropertyType::Bool; property.boolValue = value == "true"; }
+            else if (type == "color") { property.type = PropertyType::Color; property.colorValue = ParseColor(value); }
+            else if (type == "object") { property.type = PropertyType::Object; property.intValue = std::atoi(valueStr.c_str()); }
+            else
+            {
+                property.type = type == "file" ? PropertyType::File : PropertyType::String;
+                property.stringIndex = static_cast<uint32_t>(mStrings.size());
+                mStrings.push_back(std::move(valueStr));
+            }
 
-                switch (AttributeTable.at(attrName))
-                {
-                case Attribute::X:
-                    x = attr;
-                    break;
+            uint32_t index = static_cast<uint32_t>(mProperties.size());
+            if (!mIndex.emplace(IndexKey(set, property.key), index).second) return; // Duplicate name in one set, first wins
 
-                case Attribute::Y:
-                    y = attr;
-                    break;
+            mProperties.push_back(property);
+            mSets[set].second++;
+        }
 
-                case Attribute::Width:
-                    w = attr;
-                    break;
+        // Copies a set from another table into a new set of this one, returning the new set. Throws, copying nothing,
+        // if a name collides as in add().
+        PropertySet copySet(const PropertyTable& from, PropertySet set)
+        {
+            if (set == 0) return 0;
 
-                case Attribute::Height:
-                    h = attr;
-                    break;
+            for (const Property* it = from.begin(set); it != from.end(set); ++it)
+                checkKey(from.keyName(it->key));
 
-                default:
-                    break;
+            PropertySet copy = openSet();
+            for (const Property* it = from.begin(set); it != from.end(set); ++it)
+            {
+                Property property = *it;
+                property.key = internKey(from.keyName(it->key));
+                if (property.type == PropertyType::String || property.type == PropertyType::File)
+                {
+                    property.stringIndex = static_cast<uint32_t>(mStrings.size());
+                    mStrings.emplace_back(from.getString(*it));
                 }
+
+                if (!mIndex.emplace(IndexKey(copy, property.key), static_cast<uint32_t>(mProperties.size())).second) continue;
+                mProperties.push_back(property);
+                mSets[copy].second++;
             }
-            returnColliders.emplace_back(x, y, w, h);
+            return copy;
         }
-        return returnColliders;
-    }
 
-    void IO::OpenLevel(const std::filesystem::path& lvlPath, std::vector<Layer>& layerList, std::vector<TilesetData>& tilesetData, std::map<int, ColliderList>& tilesetColliders, SDL_Renderer* renderer)
-    {
-        if (!renderer && !mCurrentRenderer) return;
-        if (renderer) mCurrentRenderer = renderer;
+        // O(1) lookup by pre-hashed key. Returns nullptr if the set has no such property.
+        const Property* find(PropertySet set, PropertyKey key) const
+        {
+            auto it = mIndex.find(IndexKey(set, key));
+            return it != mIndex.end() ? &mProperties[it->second] : nullptr;
+        }
 
-        std::filesystem::path lvlName = lvlPath.parent_path().filename();
-        std::filesystem::path lvlLoc = lvlPath;
-        lvlLoc /= lvlName;
-        lvlLoc += ".tmx";
+        bool has(PropertySet set, PropertyKey key) const { return find(set, key) != nullptr; }
 
-        rapidxml::file<> xmlFile(lvlLoc.string().c_str());
-        rapidxml::xml_document<>* doc = new rapidxml::xml_document<>;
-        doc->parse<0>(xmlFile.data());
+        int getInt(PropertySet set, PropertyKey key, int fallback = 0) const
+        {
+            const Property* property = find(set, key);
+            if (!property) return fallback;
+            if (property->type == PropertyType::Int || property->type == PropertyType::Object) return property->intValue;
+            if (property->type == PropertyType::Float) return static_cast<int>(property->floatValue);
+            return fallback;
+        }
 
-        rapidxml::xml_node<>* mapNode = doc->first_node("map");
+        float getFloat(PropertySet set, PropertyKey key, float fallback = 0.0f) const
+        {
+            const Property* property = find(set, key);
+            if (!property) return fallback;
+            if (property->type == PropertyType::Float) return property->floatValue;
+            if (property->type == PropertyType::Int) return static_cast<float>(property->intValue);
+            return fallback;
+        }
 
-        GetLayers(mapNode, layerList);
-        GetTilesets(mapNode, lvlPath, tilesetData, tilesetColliders);
+        bool getBool(PropertySet set, PropertyKey key, bool fallback = false) const
+        {
+            const Property* property = find(set, key);
+            return property && property->type == PropertyType::Bool ? property->boolValue : fallback;
+        }
 
-        delete doc;
-    }
+        SDL_Color getColor(PropertySet set, PropertyKey key, SDL_Color fallback = { 0, 0, 0, 0 }) const
+        {
+            const Property* property = find(set, key);
+            if (!property || property->type != PropertyType::Color) return fallback;
 
-    // Returns a pointer to the tileset that the tileID belongs to. Returns nullptr if no match found.
-    static const TilesetData* FindTilesetData(int tileID, const std::vector<TilesetData>& tilesets)
-    {
-        auto it = std::find_if(tilesets.rbegin(), tilesets.rend(), [tileID](const auto& set) {
-            return set.firstID <= tileID;
-            });
-        if (it != tilesets.rend())
-            return &(*it);
+            uint32_t argb = property->colorValue;
+            return { static_cast<Uint8>(argb >> 16), static_cast<Uint8>(argb >> 8), static_cast<Uint8>(argb), static_cast<Uint8>(argb >> 24) };
+        }
+
+        // Also used for File properties. The view stays valid until a set of the table is released.
+        std::string_view getString(PropertySet set, PropertyKey key, std::string_view fallback = {}) const
+        {
+            const Property* property = find(set, key);
+            if (!property || (property->type != PropertyType::String && property->type != PropertyType::File)) return fallback;
+            return mStrings[property->stringIndex];
+        }
+
+        std::string_view getString(const Property& property) const
+        {
+            return property.type == PropertyType::String || property.type == PropertyType::File ? std::string_view(mStrings[property.stringIndex]) : std::string_view();
+        }
+
+        // All properties in a set, in document order
+        const Property* begin(PropertySet set) const { return mProperties.data() + mSets[set].first; }
+        const Property* end(PropertySet set) const { return begin(set) + mSets[set].second; }
+        size_t size(PropertySet set) const { return mSets[set].second; }
+
+        // Returns the original name of an interned key, or an empty view if the key was never seen
+        std::string_view keyName(PropertyKey key) const
+        {
+            auto it = mKeyNames.find(key);
+            return it != mKeyNames.end() ? std::string_view(it->second) : std::string_view();
+        }
+
+        // True if every property name in from can be interned here without colliding with a different name
+        bool canCopy(const PropertyTable& from) const
+        {
+            return std::all_of(from.mKeyNames.begin(), from.mKeyNames.end(), [this](const auto& keyName) {
+                auto it = mKeyNames.find(keyName.first);
+                return it == mKeyNames.end() || it->second == keyName.second;
+            });
+        }
+
+        size_t setCount() const { return mSets.size(); }
+
+        void clear() { *this = PropertyTable(); }
+
+        // Heap bytes owned by the table
+        size_t getMemoryUsage() const
+        {
+            size_t bytes = VectorBytes(mProperties) + VectorBytes(mSets) + HashMapBytes(mIndex) + HashMapBytes(mKeyNames) + VectorBytes(mStrings)
+                + VectorBytes(mFreeSets);
+            for (const auto& keyName : mKeyNames) bytes += StringBytes(keyName.second);
+            for (const std::string& string : mStrings) bytes += StringBytes(string);
+            return bytes;
+        }
+
+    private:
+        static uint64_t IndexKey(PropertySet set, PropertyKey key) { return (static_cast<uint64_t>(set) << 32) | key; }
+
+        // Pre-hashed queries cannot tell two names with the same hash apart, so a collision is an error rather than
+        // a lookup that could return the other name's value
+        void checkKey(std::string_view name) const
+        {
+            auto it = mKeyNames.find(HashProperty(name));
+            if (it != mKeyNames.end() && it->second != name)
+                throw std::runtime_error("property name \"" + std::string(name) + "\" has the same hash as \"" + it->second + "\"");
+        }
+
+        PropertyKey internKey(std::string_view name)
+        {
+            checkKey(name);
+            PropertyKey key = HashProperty(name);
+            mKeyNames.emplace(key, std::string(name));
+            return key;
+        }
+
+        // Drops the properties and strings of released sets. Set handles stay the same.
+        void compact()
+        {
+            std::vector<Property> properties;
+            std::vector<std::string> strings;
+            properties.reserve(mProperties.size() - mReleased);
+            mIndex.clear();
+            for (size_t set = 1; set < mSets.size(); set++)
+            {
+                uint32_t offset = static_cast<uint32_t>(properties.size());
+                for (uint32_t i = 0; i < mSets[set].second; i++)
+                {
+                    Property property = mProperties[mSets[set].first + i];
+                    if (property.type == PropertyType::String || property.type == PropertyType::File)
+                    {
+                        strings.push_back(std::move(mStrings[property.stringIndex]));
+                        property.stringIndex = static_cast<uint32_t>(strings.size() - 1);
+                    }
+                    mIndex.emplace(IndexKey(static_cast<PropertySet>(set), property.key), static_cast<uint32_t>(properties.size()));
+                    properties.push_back(property);
+                }
+                mSets[set].first = offset;
+            }
+
+            mProperties = std::move(properties);
+            mStrings = std::move(strings);
+            mReleased = 0;
+            mOpenSet = 0;
+        }
+
+        static uint32_t ParseColor(std::string_view value)
+        {
+            if (!value.empty() && value.front() == '#') value.remove_prefix(1);
+
+            uint32_t color = static_cast<uint32_t>(std::strtoul(std::string(value).c_str(), nullptr, 16));
+            // #RRGGBB has no alpha channel, treat it as opaque
+            if (value.size() <= 6) color |= 0xFF000000u;
+            return color;
+        }
+
+    private:
+        std::vector<Property> mProperties;
+        std::vector<std::pair<uint32_t, uint32_t>> mSets;  // Offset and count into mProperties
+        std::unordered_map<uint64_t, uint32_t> mIndex;
+        std::unordered_map<PropertyKey, std::string> mKeyNames;
+        std::vector<std::string> mStrings;
+
+        std::vector<PropertySet> mFreeSets;     // Released handles, reused by openSet
+        PropertySet mOpenSet = 0;               // The set add() appends to, 0 if none
+        size_t mReleased = 0;                   // Properties of released sets not yet compacted away
+    };
+
+
+    /// 
+    ///  TILESET DATA CONTAINING TEXTURE AND TILE DATA
+    /// 
+
+    // A tileset image that is decoded and uploaded the first time it is drawn. Decode can be called early from any
+    // thread to warm it; Upload is for the render thread and waits for a decode in progress.
+    class DeferredTexture
+    {
+    public:
+        DeferredTexture(std::filesystem::path image, SDL_Renderer* renderer) : mImage(std::move(image)), mRenderer(renderer) {}
+        ~DeferredTexture() { SDL_FreeSurface(mSurface); }
+
+        DeferredTexture(const DeferredTexture&) = delete;
+        DeferredTexture& operator=(const DeferredTexture&) = delete;
+
+        void Decode()
+        {
+            std::call_once(mDecoded, [this]() {
+                TMXTOSDL_PROFILE_SCOPE("IMG_Load");
+                mSurface = IMG_Load(mImage.string().c_str());
+                if (!mSurface) std::cout << "Could not load textures." << std::endl;
+            });
+        }
+
+        // Returns the texture, creating it on the first call. The texture belongs to the tileset, not to this object.
+        SDL_Texture* Upload()
+        {
+            if (mTexture) return mTexture;
+
+            Decode();
+            if (!mSurface) return nullptr;
+
+            mTexture = SDL_CreateTextureFromSurface(mRenderer, mSurface);
+            if (!mTexture) std::cout << SDL_GetError() << std::endl;
+            SDL_FreeSurface(mSurface);
+            mSurface = nullptr;
+            return mTexture;
+        }
+
+    private:
+        std::filesystem::path mImage;
+        SDL_Renderer* mRenderer;
+
+        std::once_flag mDecoded;
+        SDL_Surface* mSurface = nullptr;
+        SDL_Texture* mTexture = nullptr;
+    };
+
+    struct TilesetData
+    {
+        int firstID;
+        SDL_Texture* tilesetTex;
+        int tileWidth;
+        int tileHeight;
+        int tilesetWidth;
+        PropertySet properties = 0;
+        std::filesystem::path imagePath;    // Tileset image the texture was created from
+        std::filesystem::path source;       // External .tsx file, empty for tilesets embedded in the map
+        int textureSlot = -1;               // Slot in the TextureResidency that owns the texture, -1 if the caller owns it
+        std::shared_ptr<DeferredTexture> deferred;  // Set instead of tilesetTex by lazy loads, see Image::GetTexture
+
+        TilesetData() = default;
+        TilesetData(int id, SDL_Texture* tex, int w, int h, int setW)
+            : firstID(id), tilesetTex(tex), tileWidth(w), tileHeight(h), tilesetWidth(setW) {}
+
+        bool operator <(const TilesetData& other) const
+        {
+            return firstID < other.firstID;
+        }
+    };
+
+
+    /// 
+    ///  SDL TEXTURE FUNCTIONS
+    /// 
+	
+	class Image 
+	{
+        friend class Loader;
+
+	private:
+		static SDL_Texture* LoadTex(const char* filename, SDL_Renderer* renderer)
+		{
+			TMXTOSDL_PROFILE_SCOPE("Image::LoadTex");
+			SDL_Texture* tex = nullptr;
+			
+			SDL_Surface* tempSurface = nullptr;
+			{
+				TMXTOSDL_PROFILE_SCOPE("IMG_Load");
+				tempSurface = IMG_Load(filename);
+				if (!tempSurface) { std::cout << "Could not load textures." << std::endl; return nullptr; }
+				TMXTOSDL_PROFILE_BYTES(static_cast<size_t>(tempSurface->h) * tempSurface->pitch);
+			}
+			//The surface only lives until the texture is created
+			const size_t surfaceBytes = static_cast<size_t>(tempSurface->h) * tempSurface->pitch;
+			LoadMemory::Get().Add(surfaceBytes);
+			
+			{
+				TMXTOSDL_PROFILE_SCOPE("SDL_CreateTextureFromSurface");
+				TMXTOSDL_PROFILE_BYTES(static_cast<size_t>(tempSurface->h) * tempSurface->pitch);
+				tex = SDL_CreateTextureFromSurface(renderer, tempSurface);
+			}
+			SDL_FreeSurface(tempSurface);
+			LoadMemory::Get().Remove(surfaceBytes);
+			if (!tex) { std::cout << SDL_GetError() << std::endl; return nullptr; }
+			
+			return tex;
+		}
+
+    public:
+        // Returns the tileset's texture, creating it first if a lazy load deferred it. Call from the render thread.
+        static SDL_Texture* GetTexture(TilesetData& tileset)
+        {
+            if (!tileset.tilesetTex && tileset.deferred)
+            {
+                tileset.tilesetTex = tileset.deferred->Upload();
+                tileset.deferred.reset();
+            }
+            return tileset.tilesetTex;
+        }
+
+        static void DestroyTilesets(std::vector<TilesetData>& tilesets)
+        {
+            for (auto& tileset : tilesets)
+                SDL_DestroyTexture(tileset.tilesetTex);
+        }
+
+        static void DestroyTex(SDL_Texture* tex) { SDL_DestroyTexture(tex); }
+        static void DestroyTex(TilesetData& tileset) { SDL_DestroyTexture(tileset.tilesetTex); }
+	};
+
+    // Pixel memory of a texture, estimated from its format and size
+    inline size_t TextureBytes(SDL_Texture* texture)
+    {
+        Uint32 format = 0;
+        int width = 0, height = 0;
+        if (!texture || SDL_QueryTexture(texture, &format, nullptr, &width, &height) != 0) return 0;
+        return static_cast<size_t>(width) * height * SDL_BYTESPERPIXEL(format);
+    }
+
+    // Owns a texture and destroys it when it goes out of scope
+    class TextureHandle
+    {
+    public:
+        TextureHandle() = default;
+        explicit TextureHandle(SDL_Texture* texture) : mTexture(texture) {}
+        ~TextureHandle() { Reset(); }
+
+        TextureHandle(TextureHandle&& other) noexcept : mTexture(other.Release()) {}
+        TextureHandle& operator=(TextureHandle&& other) noexcept
+        {
+            if (this != &other) Reset(other.Release());
+            return *this;
+        }
+
+        TextureHandle(const TextureHandle&) = delete;
+        TextureHandle& operator=(const TextureHandle&) = delete;
+
+        SDL_Texture* Get() const { return mTexture; }
+        explicit operator bool() const { return mTexture != nullptr; }
+
+        // Gives up ownership without destroying the texture
+        SDL_Texture* Release()
+        {
+            SDL_Texture* texture = mTexture;
+            mTexture = nullptr;
+            return texture;
+        }
+
+        void Reset(SDL_Texture* texture = nullptr)
+        {
+            if (mTexture) SDL_DestroyTexture(mTexture);
+            mTexture = texture;
+        }
+
+    private:
+        SDL_Texture* mTexture = nullptr;
+    };
+
+
+
+    /// 
+    ///  LAYER DATA DECODING
+    /// 
+
+    // Appends every tile ID in a CSV <data> or <chunk> payload to out. GIDs are read unsigned so
+    // the flip flags in the top bits survive, then stored bit for bit in an int.
+    inline void DecodeCSV(std::string_view text, std::pmr::vector<int>& out)
+    {
+        const char* it = text.data();
+        const char* end = it + text.size();
+
+        while (it != end)
+        {
+            if (*it < '0' || *it > '9') { ++it; continue; }
+
+            uint32_t gid = 0;
+            while (it != end && *it >= '0' && *it <= '9')
+                gid = (gid * 10) + static_cast<uint32_t>(*it++ - '0');
+
+            out.push_back(static_cast<int>(gid));
+        }
+    }
+
+    // Value of each base64 character, -1 for anything else
+    inline const std::array<int8_t, 256>& Base64Table()
+    {
+        static const auto table = []() {
+            std::array<int8_t, 256> values;
+            values.fill(-1);
+            const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            for (int i = 0; i < 64; i++)
+                values[static_cast<uint8_t>(alphabet[i])] = static_cast<int8_t>(i);
+            return values;
+        }();
+        return table;
+    }
+
+    // Appends every tile ID in an uncompressed base64 payload, stored as little endian 32-bit GIDs
+    inline void DecodeBase64(std::string_view text, std::pmr::vector<int>& out)
+    {
+        const std::array<int8_t, 256>& table = Base64Table();
+
+        uint32_t bits = 0;
+        int bitCount = 0;
+        uint32_t gid = 0;
+        int byteCount = 0;
+
+        for (char c : text)
+        {
+            int8_t value = table[static_cast<uint8_t>(c)];
+            if (value < 0) continue; // Whitespace and padding
+
+            bits = (bits << 6) | static_cast<uint32_t>(value);
+            bitCount += 6;
+            if (bitCount < 8) continue;
+
+            bitCount -= 8;
+            gid |= ((bits >> bitCount) & 0xFF) << (8 * byteCount);
+            if (++byteCount == 4)
+            {
+                out.push_back(static_cast<int>(gid));
+                gid = 0;
+                byteCount = 0;
+            }
+        }
+    }
+
+    enum class LayerEncoding
+    {
+        CSV,
+        Base64
+    };
+
+    inline void DecodeLayerData(LayerEncoding encoding, std::string_view text, std::pmr::vector<int>& out)
+    {
+        if (encoding == LayerEncoding::Base64)
+            DecodeBase64(text, out);
+        else
+            DecodeCSV(text, out);
+    }
+
+    // Decodes a payload that arrives in pieces split at any byte, as it does when streaming a map.
+    // Gives the same tiles as DecodeLayerData on the whole payload.
+    class LayerDataDecoder
+    {
+    public:
+        LayerDataDecoder(LayerEncoding encoding, std::pmr::vector<int>& out) : mEncoding(encoding), mOut(out) {}
+
+        void Feed(std::string_view text)
+        {
+            if (mEncoding == LayerEncoding::Base64)
+                FeedBase64(text);
+            else
+                FeedCSV(text);
+        }
+
+        // Flushes a number still being read when the payload ends
+        void Finish()
+        {
+            if (mEncoding == LayerEncoding::CSV && mInNumber) mOut.push_back(static_cast<int>(mValue));
+            mValue = 0;
+            mInNumber = false;
+        }
+
+    private:
+        void FeedCSV(std::string_view text)
+        {
+            uint32_t value = mValue;
+            bool inNumber = mInNumber;
+            for (char c : text)
+            {
+                if (c >= '0' && c <= '9')
+                {
+                    value = (value * 10) + static_cast<uint32_t>(c - '0');
+                    inNumber = true;
+                }
+                else if (inNumber)
+                {
+                    mOut.push_back(static_cast<int>(value));
+                    value = 0;
+                    inNumber = false;
+                }
+            }
+            mValue = value;
+            mInNumber = inNumber;
+        }
+
+        void FeedBase64(std::string_view text)
+        {
+            const std::array<int8_t, 256>& table = Base64Table();
+            for (char c : text)
+            {
+                int8_t value = table[static_cast<uint8_t>(c)];
+                if (value < 0) continue;
+
+                mBits = (mBits << 6) | static_cast<uint32_t>(value);
+                mBitCount += 6;
+                if (mBitCount < 8) continue;
+
+                mBitCount -= 8;
+                mValue |= ((mBits >> mBitCount) & 0xFF) << (8 * mByteCount);
+                if (++mByteCount == 4)
+                {
+                    mOut.push_back(static_cast<int>(mValue));
+                    mValue = 0;
+                    mByteCount = 0;
+                }
+            }
+        }
+
+    private:
+        LayerEncoding mEncoding;
+        std::pmr::vector<int>& mOut;
+
+        uint32_t mValue = 0;
+        bool mInNumber = false;
+        uint32_t mBits = 0;
+        int mBitCount = 0;
+        int mByteCount = 0;
+    };
+
+
+    /// 
+    ///  LAYER CLASS CONTAINING TILE IDS
+    ///
+
+    class Layer
+    {
+        friend class Loader;
+
+    public:
+        // Tiles and chunks are allocated from the allocator's memory resource, so a container of layers
+        // with a std::pmr allocator passes its resource down to every layer.
+        using allocator_type = std::pmr::polymorphic_allocator<int>;
+
+        Layer(size_t width, size_t height, const allocator_type& allocator = {})
+            : mElements(allocator), mWidth(width), mHeight(height), mChunks(allocator), mDirtyBlocks(allocator), mModifiedBlocks(allocator)
+        {
+            mElements.reserve(width * height);
+        }
+
+        Layer(const Layer& other, const allocator_type& allocator)
+            : mElements(other.mElements, allocator), mWidth(other.mWidth), mHeight(other.mHeight), mProperties(other.mProperties),
+            mChunks(other.mChunks, allocator), mChunkWidth(other.mChunkWidth), mChunkHeight(other.mChunkHeight), mEncoding(other.mEncoding),
+            mInfinite(other.mInfinite), mDirtyBlocks(other.mDirtyBlocks, allocator), mModifiedBlocks(other.mModifiedBlocks, allocator) {}
+
+        Layer(Layer&& other, const allocator_type& allocator)
+            : mElements(std::move(other.mElements), allocator), mWidth(other.mWidth), mHeight(other.mHeight), mProperties(other.mProperties),
+            mChunks(std::move(other.mChunks), allocator), mChunkWidth(other.mChunkWidth), mChunkHeight(other.mChunkHeight), mEncoding(other.mEncoding),
+            mInfinite(other.mInfinite), mDirtyBlocks(std::move(other.mDirtyBlocks), allocator), mModifiedBlocks(std::move(other.mModifiedBlocks), allocator) {}
+
+        Layer(const Layer&) = default;
+        Layer(Layer&&) = default;
+        Layer& operator=(const Layer&) = default;
+        Layer& operator=(Layer&&) = default;
+
+        allocator_type get_allocator() const { return mElements.get_allocator(); }
+
+        // This function clears the layer of any existing values
+        void resize(size_t width, size_t height)
+        {
+            mElements.clear();
+            mElements.reserve(width * height);
+
+            mWidth = width;
+            mHeight = height;
+        }
+
+        size_t getWidth() const { return mWidth; }
+        size_t getHeight() const { return mHeight; }
+
+        std::vector<int> getRow(size_t row)
+        {
+            const auto start = mElements.begin() + (row * mWidth);
+            return std::vector<int>(start, start + mWidth);
+        }
+
+        void push_back(int element) { mElements.push_back(element); }
+
+        // Tile data of a dense layer in row-major order. Can hold fewer than width * height tiles if the map's data was short.
+        const int* data() const { return mElements.data(); }
+        size_t size() const { return mElements.size(); }
+
+        PropertySet getProperties() const { return mProperties; }
+        void setProperties(PropertySet properties) { mProperties = properties; }
+
+        void clear()
+        {
+            mElements.clear();
+            mChunks.clear();
+        }
+
+        // Dense layers only. Use getTile for layers from infinite maps. Writes through this aren't tracked, use setTile
+        // or markDirty so that structures built from the layer see them.
+        int& operator()(size_t x, size_t y) { return mElements[(mWidth * y) + x]; }
+        const int& operator()(size_t x, size_t y) const { return mElements[(mWidth * y) + x]; }
+
+        // Works for both dense and chunked layers. Returns 0 for coordinates with no tile data, including the end of
+        // a dense layer whose data was shorter than its size.
+        int getTile(int x, int y) const
+        {
+            if (!isInfinite())
+            {
+                if (x < 0 || y < 0 || static_cast<size_t>(x) >= mWidth || static_cast<size_t>(y) >= mHeight) return 0;
+                size_t index = (mWidth * y) + x;
+                return index < mElements.size() ? mElements[index] : 0;
+            }
+
+            int chunkX = FloorDiv(x, mChunkWidth);
+            int chunkY = FloorDiv(y, mChunkHeight);
+            const std::pmr::vector<int>* tiles = getChunk(chunkX, chunkY);
+            if (!tiles) return 0;
+
+            int localX = x - (chunkX * mChunkWidth);
+            int localY = y - (chunkY * mChunkHeight);
+            size_t index = (static_cast<size_t>(localY) * mChunkWidth) + localX;
+            return index < tiles->size() ? (*tiles)[index] : 0;
+        }
+
+
+        ///
+        /// INFINITE MAP CHUNKS
+        ///
+
+        // True if the layer came from an infinite map and stores its tiles in chunks. Set by the loader from the map,
+        // so a layer of an infinite map that has no chunks yet is still infinite.
+        bool isInfinite() const { return mInfinite; }
+        void setInfinite(bool infinite) { mInfinite = infinite; }
+
+        int getChunkWidth() const { return mChunkWidth; }
+        int getChunkHeight() const { return mChunkHeight; }
+        size_t getChunkCount() const { return mChunks.size(); }
+
+        // Stores the undecoded payload of a chunk. x and y are tile coordinates of the chunk origin.
+        void addChunk(int x, int y, int width, int height, std::string_view data)
+        {
+            if (mChunks.empty())
+            {
+                mChunkWidth = width;
+                mChunkHeight = height;
+            }
+            mInfinite = true;
+
+            Chunk& chunk = mChunks[ChunkKey(FloorDiv(x, mChunkWidth), FloorDiv(y, mChunkHeight))];
+            chunk.data.assign(data.data(), data.size());
+            chunk.tiles.clear();
+            chunk.decoded = false;
+        }
+
+        // Returns the tiles of the chunk at chunk coordinate (chunkX, chunkY) in row-major order, decoding it on first use.
+        // Returns nullptr if the map has no chunk there. Decoding mutates the layer, so call decodeAllChunks before
+        // sharing a chunked layer between threads.
+        const std::pmr::vector<int>* getChunk(int chunkX, int chunkY) const
+        {
+            auto it = mChunks.find(ChunkKey(chunkX, chunkY));
+            if (it == mChunks.end()) return nullptr;
+
+            Chunk& chunk = it->second;
+            if (!chunk.decoded)
+            {
+                chunk.tiles.reserve(static_cast<size_t>(mChunkWidth) * mChunkHeight);
+                DecodeLayerData(mEncoding, chunk.data, chunk.tiles);
+                chunk.data.clear();
+                chunk.data.shrink_to_fit();
+                chunk.decoded = true;
+            }
+            return &chunk.tiles;
+        }
+
+        // Chunk coordinates of every chunk in the layer
+        std::vector<std::pair<int, int>> getChunkCoords() const
+        {
+            std::vector<std::pair<int, int>> coords;
+            coords.reserve(mChunks.size());
+            for (const auto& chunk : mChunks)
+                coords.emplace_back(static_cast<int32_t>(chunk.first >> 32), static_cast<int32_t>(chunk.first & 0xFFFFFFFF));
+            return coords;
+        }
+
+        void decodeAllChunks() const
+        {
+            for (const auto& chunk : mChunks)
+                getChunk(static_cast<int32_t>(chunk.first >> 32), static_cast<int32_t>(chunk.first & 0xFFFFFFFF));
+        }
+
+
+        ///
+        /// TILE EDITING
+        ///
+
+        // Edits are tracked in blocks of this many tiles square
+        static constexpr int DirtyBlockSize = 16;
+
+        // Sets the tile at (x, y) and records the change. On a chunked layer a missing chunk is created, unless gid is 0
+        // and there is nothing to clear. On a dense layer whose data was shorter than its size the missing tiles are
+        // filled with 0 first. Returns false, changing nothing, for coordinates outside a dense layer.
+        bool setTile(int x, int y, int gid)
+        {
+            int* tile = nullptr;
+            if (!isInfinite())
+            {
+                if (x < 0 || y < 0 || static_cast<size_t>(x) >= mWidth || static_cast<size_t>(y) >= mHeight) return false;
+                fillDense();
+                tile = &mElements[(mWidth * y) + x];
+            }
+            else
+            {
+                int chunkX = FloorDiv(x, mChunkWidth);
+                int chunkY = FloorDiv(y, mChunkHeight);
+
+                //Clearing a tile where there is no chunk changes nothing, and a new empty chunk would grow the layer's bounds
+                if (!getChunk(chunkX, chunkY) && gid == 0) return true;
+
+                Chunk& chunk = mChunks[ChunkKey(chunkX, chunkY)];
+                chunk.decoded = true;
+                chunk.tiles.resize(static_cast<size_t>(mChunkWidth) * mChunkHeight, 0);
+                tile = &chunk.tiles[(static_cast<size_t>(y - (chunkY * mChunkHeight)) * mChunkWidth) + (x - (chunkX * mChunkWidth))];
+            }
+
+            if (*tile == gid) return true;
+            *tile = gid;
+
+            uint64_t block = ChunkKey(FloorDiv(x, DirtyBlockSize), FloorDiv(y, DirtyBlockSize));
+            mDirtyBlocks.insert(block);
+            mModifiedBlocks.insert(block);
+            return true;
+        }
+
+        // Sets every tile of region from tiles, in row-major order, and records the change. Tiles outside a dense
+        // layer are skipped.
+        void setTiles(const SDL_Rect& region, const int* tiles)
+        {
+            if (isInfinite())
+            {
+                for (int y = 0; y < region.h; y++)
+                {
+                    for (int x = 0; x < region.w; x++)
+                        setTile(region.x + x, region.y + y, tiles[(static_cast<size_t>(y) * region.w) + x]);
+                }
+                return;
+            }
+
+            int left = std::max(region.x, 0), right = std::min(region.x + region.w, static_cast<int>(mWidth));
+            int top = std::max(region.y, 0), bottom = std::min(region.y + region.h, static_cast<int>(mHeight));
+            if (left >= right || top >= bottom) return;
+
+            fillDense();
+            for (int y = top; y < bottom; y++)
+            {
+                const int* source = tiles + (static_cast<size_t>(y - region.y) * region.w) + (left - region.x);
+                std::copy(source, source + (right - left), mElements.begin() + (mWidth * y) + left);
+            }
+            markDirty({ left, top, right - left, bottom - top });
+        }
+
+        // Records a change made some other way, such as writing through operator()
+        void markDirty(const SDL_Rect& region)
+        {
+            if (region.w <= 0 || region.h <= 0) return;
+
+            for (int blockY = FloorDiv(region.y, DirtyBlockSize); blockY <= FloorDiv(region.y + region.h - 1, DirtyBlockSize); blockY++)
+            {
+                for (int blockX = FloorDiv(region.x, DirtyBlockSize); blockX <= FloorDiv(region.x + region.w - 1, DirtyBlockSize); blockX++)
+                {
+                    mDirtyBlocks.insert(ChunkKey(blockX, blockY));
+                    mModifiedBlocks.insert(ChunkKey(blockX, blockY));
+                }
+            }
+        }
+
+        bool isDirty() const { return !mDirtyBlocks.empty(); }
+
+        // Returns the regions changed since the last call, in tile coordinates, and forgets them. Each region is a run
+        // of whole dirty blocks along a row, clipped to the layer if it is dense.
+        std::vector<SDL_Rect> takeDirtyRegions()
+        {
+            std::vector<std::pair<int, int>> blocks;
+            blocks.reserve(mDirtyBlocks.size());
+            for (uint64_t key : mDirtyBlocks)
+                blocks.emplace_back(static_cast<int32_t>(key & 0xFFFFFFFF), static_cast<int32_t>(key >> 32));
+            mDirtyBlocks.clear();
+            std::sort(blocks.begin(), blocks.end());
+
+            //Blocks are sorted by row then column, so runs are adjacent
+            std::vector<SDL_Rect> regions;
+            for (size_t i = 0; i < blocks.size();)
+            {
+                size_t end = i + 1;
+                while (end < blocks.size() && blocks[end].first == blocks[i].first && blocks[end].second == blocks[end - 1].second + 1)
+                    end++;
+
+                SDL_Rect region = { blocks[i].second * DirtyBlockSize, blocks[i].first * DirtyBlockSize, static_cast<int>(end - i) * DirtyBlockSize, DirtyBlockSize };
+                if (!isInfinite())
+                {
+                    int right = std::min(region.x + region.w, static_cast<int>(mWidth)), bottom = std::min(region.y + region.h, static_cast<int>(mHeight));
+                    region.x = std::max(region.x, 0);
+                    region.y = std::max(region.y, 0);
+                    region.w = right - region.x;
+                    region.h = bottom - region.y;
+                }
+                if (region.w > 0 && region.h > 0) regions.push_back(region);
+                i = end;
+            }
+            return regions;
+        }
+
+        // Block coordinates of every block edited since the layer was loaded or clearModified was called. Unlike the
+        // dirty regions these are not cleared by takeDirtyRegions, so saves can find everything that changed.
+        std::vector<std::pair<int, int>> getModifiedBlocks() const
+        {
+            std::vector<std::pair<int, int>> blocks;
+            blocks.reserve(mModifiedBlocks.size());
+            for (uint64_t key : mModifiedBlocks)
+                blocks.emplace_back(static_cast<int32_t>(key >> 32), static_cast<int32_t>(key & 0xFFFFFFFF));
+            return blocks;
+        }
+
+        size_t getModifiedBlockCount() const { return mModifiedBlocks.size(); }
+        void clearModified() { mModifiedBlocks.clear(); }
+
+        // Heap bytes of tile IDs, including decoded chunks and chunk payloads not yet decoded
+        size_t getTileBytes() const
+        {
+            size_t bytes = VectorBytes(mElements);
+            for (const auto& chunk : mChunks)
+                bytes += VectorBytes(chunk.second.tiles) + StringBytes(chunk.second.data);
+            return bytes;
+        }
+
+        // Heap bytes of the chunk lookup itself
+        size_t getOverheadBytes() const { return HashMapBytes(mChunks) + HashMapBytes(mDirtyBlocks) + HashMapBytes(mModifiedBlocks); }
+
+    private:
+        struct Chunk
+        {
+            using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+            explicit Chunk(const allocator_type& allocator = {}) : data(allocator), tiles(allocator) {}
+            Chunk(const Chunk& other, const allocator_type& allocator) : data(other.data, allocator), tiles(other.tiles, allocator), decoded(other.decoded) {}
+            Chunk(Chunk&& other, const allocator_type& allocator) : data(std::move(other.data), allocator), tiles(std::move(other.tiles), allocator), decoded(other.decoded) {}
+            Chunk(const Chunk&) = default;
+            Chunk(Chunk&&) = default;
+            Chunk& operator=(const Chunk&) = default;
+            Chunk& operator=(Chunk&&) = default;
+
+            std::pmr::string data;
+            std::pmr::vector<int> tiles;
+            bool decoded = false;
+        };
+
+        // Pads the data of a dense layer out to its full size, so that any tile within it can be written
+        void fillDense()
+        {
+            if (mElements.size() < mWidth * mHeight) mElements.resize(mWidth * mHeight, 0);
+        }
+
+        static uint64_t ChunkKey(int chunkX, int chunkY) { return (static_cast<uint64_t>(static_cast<uint32_t>(chunkX)) << 32) | static_cast<uint32_t>(chunkY); }
+        static int FloorDiv(int value, int divisor) { return (value / divisor) - (value % divisor < 0 ? 1 : 0); }
+
+    private:
+        std::pmr::vector<int> mElements;
+        size_t mWidth;
+        size_t mHeight;
+        PropertySet mProperties = 0;
+
+        mutable std::pmr::unordered_map<uint64_t, Chunk> mChunks;
+        int mChunkWidth = 16;
+        int mChunkHeight = 16;
+        LayerEncoding mEncoding = LayerEncoding::CSV;
+        bool mInfinite = false;
+
+        std::pmr::unordered_set<uint64_t> mDirtyBlocks;    // Keyed like chunks, by block coordinate
+        std::pmr::unordered_set<uint64_t> mModifiedBlocks;
+    };
+
+
+    /// 
+    ///  OBJECT LAYER DATA STORED AS STRUCTURE OF ARRAYS
+    /// 
+
+    // A map level <objectgroup>. Its objects occupy [first, first + count) in the ObjectData columns.
+    struct ObjectGroup
+    {
+        std::string name;
+        int id;
+        size_t first;
+        size_t count;
+    };
+
+    struct ObjectData
+    {
+        std::vector<ObjectGroup> groups;
+
+        // One entry per object, in document order
+        std::vector<int> id;
+        std::vector<uint16_t> type;         // Index into typeNames, 0 if the object has no type
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> width;
+        std::vector<float> height;
+        std::vector<float> rotation;
+        std::vector<uint32_t> gid;          // Raw gid including flip flags, 0 if not a tile object
+        std::vector<PropertySet> properties;    // Property range of the object in Level::properties
+
+        // Interned type names
+        std::vector<std::string> typeNames = { "" };
+
+        size_t size() const { return id.size(); }
+
+        void reserve(size_t count)
+        {
+            id.reserve(count);
+            type.reserve(count);
+            x.reserve(count);
+            y.reserve(count);
+            width.reserve(count);
+            height.reserve(count);
+            rotation.reserve(count);
+            gid.reserve(count);
+            properties.reserve(count);
+        }
+
+        void clear()
+        {
+            *this = ObjectData();
+        }
+
+        uint16_t internType(std::string_view name)
+        {
+            if (name.empty()) return 0;
+
+            auto it = mTypeLookup.find(std::string(name));
+            if (it != mTypeLookup.end()) return it->second;
+
+            uint16_t index = static_cast<uint16_t>(typeNames.size());
+            typeNames.emplace_back(name);
+            mTypeLookup.emplace(typeNames.back(), index);
+            return index;
+        }
+
+        // Returns the type index for the given name, or 0 if no object uses it.
+        uint16_t findType(const std::string& name) const
+        {
+            auto it = mTypeLookup.find(name);
+            return it != mTypeLookup.end() ? it->second : 0;
+        }
+
+        // Heap bytes owned by the columns, groups and type names
+        size_t getMemoryUsage() const
+        {
+            size_t bytes = VectorBytes(groups) + VectorBytes(id) + VectorBytes(type) + VectorBytes(x) + VectorBytes(y) + VectorBytes(width)
+                + VectorBytes(height) + VectorBytes(rotation) + VectorBytes(gid) + VectorBytes(properties) + VectorBytes(typeNames) + HashMapBytes(mTypeLookup);
+            for (const ObjectGroup& group : groups) bytes += StringBytes(group.name);
+            for (const std::string& name : typeNames) bytes += 2 * StringBytes(name);   // Also copied as the lookup key
+            return bytes;
+        }
+
+    private:
+        std::unordered_map<std::string, uint16_t> mTypeLookup;
+    };
+
+
+    /// 
+    ///  TIME SPENT IN EACH STAGE OF LOADING A LEVEL
+    /// 
+
+    struct LoadStats
+    {
+        double readSeconds = 0.0;       // Reading the .tmx into memory
+        double parseSeconds = 0.0;      // XML parse of the .tmx
+        double layerSeconds = 0.0;      // Decoding layer data
+        double tilesetSeconds = 0.0;    // Reading and parsing tilesets and their colliders, excluding images
+        double imageSeconds = 0.0;      // Decoding tileset images and uploading textures
+        double objectSeconds = 0.0;     // Object layers
+        double totalSeconds = 0.0;
+
+        size_t fileBytes = 0;           // Bytes of .tmx and .tsx read
+        size_t tileCount = 0;           // Tiles decoded during the load, excluding chunks decoded later on demand
+
+        size_t parseBytes = 0;          // Most transient memory alive at once: file buffers, XML documents and decoded images
+        size_t peakBytes = 0;           // Upper bound of heap memory in use during the load, parseBytes plus the finished level
+    };
+
+    // Adds the time between construction and destruction to an accumulator
+    class StageTimer
+    {
+    public:
+        explicit StageTimer(double& seconds) : mSeconds(seconds), mStart(std::chrono::steady_clock::now()) {}
+        ~StageTimer() { mSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count(); }
+
+        StageTimer(const StageTimer&) = delete;
+        StageTimer& operator=(const StageTimer&) = delete;
+
+    private:
+        double& mSeconds;
+        std::chrono::steady_clock::time_point mStart;
+    };
+
+
+    /// 
+    ///  BIT-PACKED WALKABILITY GRID
+    /// 
+
+    // One bit per map cell, set where the cell is solid. Each row is padded to whole 64 bit words, so a row can be
+    // tested 64 cells at a time. Cells are addressed in map tile coordinates; for infinite maps the grid starts at
+    // the top left chunk, which can be negative. Cells outside the grid read as solid.
+    class WalkabilityGrid
+    {
+    public:
+        WalkabilityGrid() = default;
+        WalkabilityGrid(int originX, int originY, int width, int height)
+            : mOriginX(originX), mOriginY(originY), mWidth(std::max(width, 0)), mHeight(std::max(height, 0)),
+            mWordsPerRow((static_cast<size_t>(mWidth) + 63) / 64), mWords(mWordsPerRow * mHeight, 0) {}
+
+        int GetOriginX() const { return mOriginX; }
+        int GetOriginY() const { return mOriginY; }
+        int GetWidth() const { return mWidth; }
+        int GetHeight() const { return mHeight; }
+        size_t GetWordsPerRow() const { return mWordsPerRow; }
+
+        bool Contains(int x, int y) const
+        {
+            return x >= mOriginX && y >= mOriginY && x - mOriginX < mWidth && y - mOriginY < mHeight;
+        }
+
+        bool IsSolid(int x, int y) const
+        {
+            if (!Contains(x, y)) return true;
+            size_t column = static_cast<size_t>(x - mOriginX);
+            return (mWords[(static_cast<size_t>(y - mOriginY) * mWordsPerRow) + (column / 64)] >> (column % 64)) & 1;
+        }
+
+        bool IsWalkable(int x, int y) const { return !IsSolid(x, y); }
+
+        void SetSolid(int x, int y, bool solid)
+        {
+            if (!Contains(x, y)) return;
+            size_t column = static_cast<size_t>(x - mOriginX);
+            uint64_t& word = mWords[(static_cast<size_t>(y - mOriginY) * mWordsPerRow) + (column / 64)];
+            uint64_t bit = uint64_t(1) << (column % 64);
+            word = solid ? (word | bit) : (word & ~bit);
+        }
+
+        // Words of a row, counted from the grid's origin. Bit i of word w is cell originX + (w * 64) + i. Padding bits
+        // past the last column are always 0.
+        const uint64_t* GetRow(int y) const { return mWords.data() + (static_cast<size_t>(y - mOriginY) * mWordsPerRow); }
+        uint64_t* GetRow(int y) { return mWords.data() + (static_cast<size_t>(y - mOriginY) * mWordsPerRow); }
+
+        // The 64 cells starting at (x, y), at any alignment. Bit i is cell x + i. Cells outside the grid are solid.
+        uint64_t GetWord(int x, int y) const
+        {
+            if (y < mOriginY || y - mOriginY >= mHeight) return ~uint64_t(0);
+
+            const uint64_t* row = GetRow(y);
+            int64_t column = static_cast<int64_t>(x) - mOriginX;
+            uint64_t word = 0;
+            for (int part = 0; part < 2; part++)
+            {
+                int64_t start = column + (part * 64);
+                int64_t index = start >= 0 ? start / 64 : -1 - ((-start - 1) / 64);
+                int shift = static_cast<int>(start - (index * 64));
+                if (part == 1 && shift == 0) break;
+
+                uint64_t value = index >= 0 && static_cast<size_t>(index) < mWordsPerRow ? row[index] : ~uint64_t(0);
+                if (part == 0) word = value >> shift;
+                else word |= value << (64 - shift);
+            }
+
+            //Bits past the right edge are padding, report them as solid
+            int64_t valid = static_cast<int64_t>(mWidth) - column;
+            if (valid < 64) word |= valid <= 0 ? ~uint64_t(0) : ~uint64_t(0) << valid;
+            if (column < 0) word |= column <= -64 ? ~uint64_t(0) : ~uint64_t(0) >> (64 + column);
+            return word;
+        }
+
+        size_t CountSolid() const
+        {
+            size_t count = 0;
+            for (uint64_t word : mWords)
+                count += std::bitset<64>(word).count();
+            return count;
+        }
+
+        size_t GetMemoryUsage() const { return sizeof(WalkabilityGrid) + VectorBytes(mWords); }
+
+    private:
+        int mOriginX = 0;
+        int mOriginY = 0;
+        int mWidth = 0;
+        int mHeight = 0;
+        size_t mWordsPerRow = 0;
+        std::vector<uint64_t> mWords;
+    };
+
+    struct WalkabilityOptions
+    {
+        std::vector<size_t> layers;     // Layers to read, all of them if empty
+        bool anyTileIsSolid = false;    // Every non-empty tile is solid, for dedicated collision layers
+        size_t threadCount = 0;         // 0 for one per core
+    };
+
+
+    /// 
+    ///  ALL DATA EXTRACTED FROM A SINGLE .TMX FILE
+    /// 
+
+    struct Level
+    {
+        Level() : Level(std::pmr::get_default_resource()) {}
+
+        // Layers, colliders and the tile property index are allocated from resource, which must outlive the level.
+        // With a std::pmr::monotonic_buffer_resource all of them are released at once with the arena.
+        explicit Level(std::pmr::memory_resource* resource)
+            : layers(resource), tilesetColliders(resource), tileProperties(resource) {}
+
+        std::pmr::vector<Layer> layers;
+        std::vector<TilesetData> tilesets;
+        ColliderMap tilesetColliders;
+        int tileWidth = 0;      // Size of a map cell in pixels
+        int tileHeight = 0;
+        ObjectData objects;
+
+        // Custom properties of the map, layers, tilesets, tiles and objects all live in one table
+        PropertyTable properties;
+        PropertySet mapProperties = 0;
+        std::pmr::unordered_map<int, PropertySet> tileProperties;   // Keyed by global tile ID
+
+        // Built during the load by a Loader with SetWalkability, empty otherwise. Tile edits and hot reloads don't
+        // update it, call RefreshWalkabilityGrid for the regions they change.
+        WalkabilityGrid walkability;
+
+        LoadStats stats;
+    };
+
+    // Bytes used by a loaded level, by category
+    struct MemoryReport
+    {
+        size_t tileBytes = 0;           // Layer tile IDs, chunk payloads and the walkability grid
+        size_t colliderBytes = 0;       // Collider rectangles
+        size_t objectBytes = 0;         // Object columns and type names
+        size_t propertyBytes = 0;       // Custom property table
+        size_t mapOverheadBytes = 0;    // The Level itself, container nodes, hash buckets and tileset records
+        size_t textureBytes = 0;        // Pixel memory of tileset textures, estimated from their format and size
+        size_t parseBytes = 0;          // Transient buffers at their peak during the load, already freed
+        size_t peakLoadBytes = 0;       // Upper bound of heap memory in use during the load
+
+        // Memory held for as long as the level is loaded, excluding textures
+        size_t residentBytes() const { return tileBytes + colliderBytes + objectBytes + propertyBytes + mapOverheadBytes; }
+        size_t totalBytes() const { return residentBytes() + textureBytes; }
+    };
+
+    // Walks the level's containers. Textures shared between tilesets are counted once.
+    inline MemoryReport GetMemoryReport(const Level& level)
+    {
+        MemoryReport report;
+
+        report.mapOverheadBytes = sizeof(Level) + VectorBytes(level.layers) + VectorBytes(level.tilesets)
+            + TreeMapBytes(level.tilesetColliders) + HashMapBytes(level.tileProperties);
+
+        for (const Layer& layer : level.layers)
+        {
+            report.tileBytes += layer.getTileBytes();
+            report.mapOverheadBytes += layer.getOverheadBytes();
+        }
+        report.tileBytes += level.walkability.GetMemoryUsage() - sizeof(WalkabilityGrid);
+
+        for (const auto& colliders : level.tilesetColliders)
+            report.colliderBytes += VectorBytes(colliders.second);
+
+        report.objectBytes = level.objects.getMemoryUsage();
+        report.propertyBytes = level.properties.getMemoryUsage();
+
+        std::vector<SDL_Texture*> textures;
+        for (const TilesetData& tileset : level.tilesets)
+        {
+            report.mapOverheadBytes += StringBytes(tileset.imagePath.native()) + StringBytes(tileset.source.native());
+
+            if (!tileset.tilesetTex || std::find(textures.begin(), textures.end(), tileset.tilesetTex) != textures.end()) continue;
+            textures.push_back(tileset.tilesetTex);
+            report.textureBytes += TextureBytes(tileset.tilesetTex);
+        }
+
+        report.parseBytes = level.stats.parseBytes;
+        report.peakLoadBytes = level.stats.peakBytes;
+        return report;
+    }
+
+
+    /// 
+    ///  FIXED SIZE WORKER THREAD POOL
+    /// 
+
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(size_t threadCount = std::max(1u, std::thread::hardware_concurrency()))
+        {
+            mThreads.reserve(threadCount);
+            for (size_t i = 0; i < threadCount; i++)
+                mThreads.emplace_back([this]() { WorkerLoop(); });
+        }
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStopping = true;
+            }
+            mCondition.notify_all();
+
+            for (auto& thread : mThreads)
+                thread.join();
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Queues a task and returns a future for its result. Exceptions thrown by the task are rethrown by future::get.
+        template<typename F>
+        auto Enqueue(F&& task) -> std::future<decltype(task())>
+        {
+            using Result = decltype(task());
+
+            auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+            std::future<Result> result = packaged->get_future();
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mTasks.emplace_back([packaged]() { (*packaged)(); });
+            }
+            mCondition.notify_one();
+            return result;
+        }
+
+        size_t GetThreadCount() const { return mThreads.size(); }
+
+        // True when called from one of this pool's workers. A task that queued more work on its own pool and waited
+        // for it could deadlock once every worker is waiting, so such callers should do the work inline instead.
+        bool IsWorkerThread() const { return CurrentPool() == this; }
+
+    private:
+        static const ThreadPool*& CurrentPool()
+        {
+            thread_local const ThreadPool* pool = nullptr;
+            return pool;
+        }
+
+        void WorkerLoop()
+        {
+            CurrentPool() = this;
+            while (true)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mMutex);
+                    mCondition.wait(lock, [this]() { return mStopping || !mTasks.empty(); });
+                    if (mTasks.empty()) return;
+
+                    task = std::move(mTasks.front());
+                    mTasks.pop_front();
+                }
+                task();
+            }
+        }
+
+    private:
+        std::vector<std::thread> mThreads;
+        std::deque<std::function<void()>> mTasks;
+        std::mutex mMutex;
+        std::condition_variable mCondition;
+        bool mStopping = false;
+    };
+
+
+    /// 
+    ///  MAP ENTRY OF A TILED .WORLD FILE
+    /// 
+
+    struct WorldMap
+    {
+        std::filesystem::path file;     // Absolute or relative to the working directory, not to the .world file
+        int x;                          // Position and size in world pixels
+        int y;
+        int width;
+        int height;
+    };
+
+
+    /// 
+    ///  MINIMAL JSON READER FOR .WORLD FILES
+    /// 
+
+    struct JsonValue
+    {
+        enum class Type { Null, Bool, Number, String, Array, Object };
+
+        Type type = Type::Null;
+        bool boolean = false;
+        double number = 0.0;
+        std::string string;
+        std::vector<JsonValue> array;
+        std::vector<std::pair<std::string, JsonValue>> object;
+
+        // Returns the member with the given key, or nullptr if this is not an object or has no such member
+        const JsonValue* find(std::string_view key) const
+        {
+            for (const auto& member : object)
+            {
+                if (member.first == key) return &member.second;
+            }
+            return nullptr;
+        }
+
+        double getNumber(std::string_view key, double fallback = 0.0) const
+        {
+            const JsonValue* value = find(key);
+            return value && value->type == Type::Number ? value->number : fallback;
+        }
+
+        std::string getString(std::string_view key) const
+        {
+            const JsonValue* value = find(key);
+            return value && value->type == Type::String ? value->string : std::string();
+        }
+
+        // Returns false on malformed input
+        static bool Parse(std::string_view text, JsonValue& out)
+        {
+            const char* it = text.data();
+            const char* end = it + text.size();
+            return ParseValue(it, end, out, 0);
+        }
+
+    private:
+        static void SkipWhitespace(const char*& it, const char* end)
+        {
+            while (it != end && (*it == ' ' || *it == '\t' || *it == '\n' || *it == '\r')) ++it;
+        }
+
+        static bool ParseString(const char*& it, const char* end, std::string& out)
+        {
+            if (it == end || *it != '"') return false;
+            ++it;
+
+            while (it != end && *it != '"')
+            {
+                char c = *it++;
+                if (c != '\\') { out.push_back(c); continue; }
+                if (it == end) return false;
+
+                switch (char escaped = *it++)
+                {
+                case 'n': out.push_back('\n'); break;
+                case 't': out.push_back('\t'); break;
+                case 'r': out.push_back('\r'); break;
+                case 'b': out.push_back('\b'); break;
+                case 'f': out.push_back('\f'); break;
+                case 'u':
+                {
+                    // Only needed for file names, so code points are narrowed to UTF-8 without surrogate handling
+                    if (end - it < 4) return false;
+                    uint32_t codePoint = static_cast<uint32_t>(std::strtoul(std::string(it, 4).c_str(), nullptr, 16));
+                    it += 4;
+                    if (codePoint < 0x80) out.push_back(static_cast<char>(codePoint));
+                    else if (codePoint < 0x800) { out.push_back(static_cast<char>(0xC0 | (codePoint >> 6))); out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F))); }
+                    else { out.push_back(static_cast<char>(0xE0 | (codePoint >> 12))); out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F))); out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F))); }
+                    break;
+                }
+                default: out.push_back(escaped); break;
+                }
+            }
+
+            if (it == end) return false;
+            ++it;
+            return true;
+        }
+
+        static bool ParseValue(const char*& it, const char* end, JsonValue& out, int depth)
+        {
+            if (depth > 64) return false;
+
+            SkipWhitespace(it, end);
+            if (it == end) return false;
+
+            switch (*it)
+            {
+            case '{':
+            {
+                out.type = Type::Object;
+                ++it;
+                SkipWhitespace(it, end);
+                if (it != end && *it == '}') { ++it; return true; }
+
+                while (true)
+                {
+                    std::pair<std::string, JsonValue> member;
+                    SkipWhitespace(it, end);
+                    if (!ParseString(it, end, member.first)) return false;
+                    SkipWhitespace(it, end);
+                    if (it == end || *it++ != ':') return false;
+                    if (!ParseValue(it, end, member.second, depth + 1)) return false;
+                    out.object.push_back(std::move(member));
+
+                    SkipWhitespace(it, end);
+                    if (it == end) return false;
+                    if (*it == ',') { ++it; continue; }
+                    if (*it == '}') { ++it; return true; }
+                    return false;
+                }
+            }
+            case '[':
+            {
+                out.type = Type::Array;
+                ++it;
+                SkipWhitespace(it, end);
+                if (it != end && *it == ']') { ++it; return true; }
+
+                while (true)
+                {
+                    if (!ParseValue(it, end, out.array.emplace_back(), depth + 1)) return false;
+
+                    SkipWhitespace(it, end);
+                    if (it == end) return false;
+                    if (*it == ',') { ++it; continue; }
+                    if (*it == ']') { ++it; return true; }
+                    return false;
+                }
+            }
+            case '"':
+                out.type = Type::String;
+                return ParseString(it, end, out.string);
+            case 't':
+            case 'f':
+            case 'n':
+            {
+                std::string_view rest(it, end - it);
+                if (rest.substr(0, 4) == "true") { out.type = Type::Bool; out.boolean = true; it += 4; return true; }
+                if (rest.substr(0, 5) == "false") { out.type = Type::Bool; it += 5; return true; }
+                if (rest.substr(0, 4) == "null") { it += 4; return true; }
+                return false;
+            }
+            default:
+            {
+                const char* numberEnd = it;
+                while (numberEnd != end && (std::isdigit(static_cast<unsigned char>(*numberEnd)) || *numberEnd == '-' || *numberEnd == '+' || *numberEnd == '.' || *numberEnd == 'e' || *numberEnd == 'E'))
+                    ++numberEnd;
+                if (numberEnd == it) return false;
+
+                out.type = Type::Number;
+                out.number = std::strtod(std::string(it, numberEnd).c_str(), nullptr);
+                it = numberEnd;
+                return true;
+            }
+            }
+        }
+    };
+
+
+    /// 
+    ///  STREAMING XML READER FOR LARGE MAPS
+    /// 
+
+    // One tag as it appears in the file, brackets included
+    struct XmlTag
+    {
+        enum class Kind
+        {
+            Open,
+            Close,
+            SelfClosing,
+            Other       // Comments, CDATA, declarations and processing instructions
+        };
+
+        Kind kind = Kind::Other;
+        std::string text;
+
+        std::string_view name() const
+        {
+            size_t start = kind == Kind::Close ? 2 : 1;
+            size_t end = text.find_first_of(" \t\r\n/>", start);
+            return std::string_view(text).substr(start, end - start);
+        }
+
+        // Raw value of an attribute, or an empty view if the tag doesn't have it. Like a non-destructive
+        // parse the value is followed by its closing quote, and a missing value points at the terminating
+        // null, so numbers can always be read with atoi.
+        std::string_view attribute(std::string_view attrName) const
+        {
+            std::string_view view(text);
+            size_t pos = view.find_first_of(" \t\r\n");
+            while (pos != std::string_view::npos)
+            {
+                pos = view.find_first_not_of(" \t\r\n", pos);
+                size_t equals = view.find('=', pos);
+                if (pos == std::string_view::npos || equals == std::string_view::npos) break;
+
+                size_t quote = view.find_first_of("\"'", equals);
+                size_t close = quote == std::string_view::npos ? quote : view.find(view[quote], quote + 1);
+                if (close == std::string_view::npos) break;
+
+                std::string_view candidate = view.substr(pos, equals - pos);
+                while (!candidate.empty() && std::isspace(static_cast<unsigned char>(candidate.back()))) candidate.remove_suffix(1);
+                if (candidate == attrName) return view.substr(quote + 1, close - quote - 1);
+                pos = close + 1;
+            }
+            return std::string_view(text.c_str() + text.size(), 0);
+        }
+    };
+
+    // Reads an XML file through a fixed size block, one tag or run of text at a time. Memory use is the
+    // block plus the longest single tag, however large the file is.
+    class XmlStream
+    {
+    public:
+        // Throws std::runtime_error if the file can't be opened
+        XmlStream(const std::filesystem::path& path, size_t blockSize, double& readSeconds)
+            : mFile(path, std::ios::binary), mBlock(std::max<size_t>(blockSize, 256)), mReadSeconds(readSeconds)
+        {
+            if (!mFile) throw std::runtime_error("cannot open file " + path.string());
+            LoadMemory::Get().Add(mBlock.size());
+        }
+
+        ~XmlStream() { LoadMemory::Get().Remove(mBlock.size()); }
+
+        size_t GetBytesRead() const { return mBytesRead; }
+
+        XmlStream(const XmlStream&) = delete;
+        XmlStream& operator=(const XmlStream&) = delete;
+
+        // Skips any text and reads the next tag. Returns false at the end of the file.
+        bool NextTag(XmlTag& tag)
+        {
+            tag.text.clear();
+            while (true)
+            {
+                if (mPos == mEnd && !Fill()) return false;
+                const char* open = static_cast<const char*>(std::memchr(mBlock.data() + mPos, '<', mEnd - mPos));
+                if (open)
+                {
+                    mPos = open - mBlock.data();
+                    break;
+                }
+                mPos = mEnd;
+            }
+
+            //Quotes only matter inside elements, comments and CDATA may contain anything
+            char quote = 0;
+            bool markup = false;
+            while (true)
+            {
+                if (mPos == mEnd && !Fill()) throw std::runtime_error("unexpected end of file inside a tag");
+                char c = mBlock[mPos++];
+                tag.text += c;
+
+                if (tag.text.size() == 2) markup = c == '!';
+                if (quote)
+                {
+                    if (c == quote) quote = 0;
+                }
+                else if (!markup && (c == '"' || c == '\''))
+                {
+                    quote = c;
+                }
+                else if (c == '>')
+                {
+                    if (tag.text.compare(0, 4, "<!--") == 0 && !EndsWith(tag.text, "-->")) continue;
+                    if (tag.text.compare(0, 9, "<![CDATA[") == 0 && !EndsWith(tag.text, "]]>")) continue;
+                    break;
+                }
+            }
+
+            if (tag.text[1] == '/') tag.kind = XmlTag::Kind::Close;
+            else if (tag.text[1] == '!' || tag.text[1] == '?') tag.kind = XmlTag::Kind::Other;
+            else if (EndsWith(tag.text, "/>")) tag.kind = XmlTag::Kind::SelfClosing;
+            else tag.kind = XmlTag::Kind::Open;
+            return true;
+        }
+
+        // Passes the text up to the next tag to sink in pieces, without copying it
+        template<typename Sink>
+        void ReadText(Sink&& sink)
+        {
+            while (mPos != mEnd || Fill())
+            {
+                const char* begin = mBlock.data() + mPos;
+                const char* open = static_cast<const char*>(std::memchr(begin, '<', mEnd - mPos));
+                size_t length = open ? static_cast<size_t>(open - begin) : mEnd - mPos;
+                if (length) sink(std::string_view(begin, length));
+
+                mPos += length;
+                if (open) return;
+            }
+        }
+
+        // Consumes the rest of an element whose opening tag was just read. Its full text is stored in out
+        // unless out is null, in which case the element is skipped.
+        void ReadElement(const XmlTag& tag, std::string* out)
+        {
+            if (out) *out = tag.text;
+            if (tag.kind != XmlTag::Kind::Open) return;
+
+            for (int depth = 1; depth > 0;)
+            {
+                ReadText([out](std::string_view text) { if (out) out->append(text); });
+                if (!NextTag(mScratch)) throw std::runtime_error("unexpected end of file inside <" + std::string(tag.name()) + ">");
+                if (out) *out += mScratch.text;
+
+                if (mScratch.kind == XmlTag::Kind::Open) depth++;
+                else if (mScratch.kind == XmlTag::Kind::Close) depth--;
+            }
+        }
+
+    private:
+        bool Fill()
+        {
+            StageTimer timer(mReadSeconds);
+            mFile.read(mBlock.data(), static_cast<std::streamsize>(mBlock.size()));
+            mPos = 0;
+            mEnd = static_cast<size_t>(mFile.gcount());
+            mBytesRead += mEnd;
+            return mEnd > 0;
+        }
+
+        static bool EndsWith(const std::string& text, std::string_view suffix)
+        {
+            return text.size() >= suffix.size() && std::string_view(text).substr(text.size() - suffix.size()) == suffix;
+        }
+
+    private:
+        std::ifstream mFile;
+        std::vector<char> mBlock;
+        size_t mPos = 0;
+        size_t mEnd = 0;
+        size_t mBytesRead = 0;
+        double& mReadSeconds;
+        XmlTag mScratch;
+    };
+
+
+    /// 
+    ///  XML ATTRIBUTE ENUM
+    /// 
+
+    enum class Attribute
+    {
+        X,
+        Y,
+        Width,
+        Height,
+        ID,
+        Type,
+        Rotation,
+        GID
+    };
+
+
+    /// 
+    ///  ATTRIBUTE STRING TO ENUM LOOKUP TABLE
+    /// 
+
+    static const std::unordered_map<std::string, Attribute> AttributeTable =
+    {
+        {"x", Attribute::X},
+        {"y", Attribute::Y},
+        {"width", Attribute::Width},
+        {"height", Attribute::Height},
+        {"id", Attribute::ID},
+        {"type", Attribute::Type},
+        {"class", Attribute::Type},
+        {"rotation", Attribute::Rotation},
+        {"gid", Attribute::GID}
+    };
+
+    // Child elements of <map> and <tileset> that the loader handles
+    enum class Element
+    {
+        Layer,
+        ObjectGroup,
+        Tileset,
+        Image,
+        Tile,
+        Properties
+    };
+
+    static const std::unordered_map<std::string_view, Element> ElementTable =
+    {
+        {"layer", Element::Layer},
+        {"objectgroup", Element::ObjectGroup},
+        {"tileset", Element::Tileset},
+        {"image", Element::Image},
+        {"tile", Element::Tile},
+        {"properties", Element::Properties}
+    };
+
+
+    /// 
+    ///  WALKABILITY GRIDS BUILT FROM A LEVEL
+    /// 
+
+    // Tiles covered by a layer, in map tile coordinates. For infinite layers this is the bounding box of their chunks.
+    inline SDL_Rect GetLayerBounds(const Layer& layer)
+    {
+        if (!layer.isInfinite()) return { 0, 0, static_cast<int>(layer.getWidth()), static_cast<int>(layer.getHeight()) };
+
+        std::vector<std::pair<int, int>> chunks = layer.getChunkCoords();
+        if (chunks.empty()) return { 0, 0, 0, 0 };
+
+        int minX = std::numeric_limits<int>::max(), minY = std::numeric_limits<int>::max();
+        int maxX = std::numeric_limits<int>::min(), maxY = std::numeric_limits<int>::min();
+        for (const std::pair<int, int>& chunk : chunks)
+        {
+            minX = std::min(minX, chunk.first * layer.getChunkWidth());
+            minY = std::min(minY, chunk.second * layer.getChunkHeight());
+            maxX = std::max(maxX, (chunk.first + 1) * layer.getChunkWidth());
+            maxY = std::max(maxY, (chunk.second + 1) * layer.getChunkHeight());
+        }
+        return { minX, minY, maxX - minX, maxY - minY };
+    }
+
+    // Recomputes the cells of region (in map tile coordinates) from the level. A cell is solid if any of the chosen
+    // layers has a tile there whose GID has colliders, or any tile at all with anyTileIsSolid. Rows are split between
+    // threads when the region is large.
+    inline void RefreshWalkabilityGrid(WalkabilityGrid& grid, const Level& level, const WalkabilityOptions& options, const SDL_Rect& region)
+    {
+        TMXTOSDL_PROFILE_SCOPE("RefreshWalkabilityGrid");
+        int left = std::max(region.x, grid.GetOriginX());
+        int top = std::max(region.y, grid.GetOriginY());
+        int right = std::min(region.x + region.w, grid.GetOriginX() + grid.GetWidth());
+        int bottom = std::min(region.y + region.h, grid.GetOriginY() + grid.GetHeight());
+        if (left >= right || top >= bottom) return;
+
+        std::vector<const Layer*> layers;
+        if (options.layers.empty())
+        {
+            for (const Layer& layer : level.layers)
+                layers.push_back(&layer);
+        }
+        else
+        {
+            for (size_t index : options.layers)
+            {
+                if (index < level.layers.size()) layers.push_back(&level.layers[index]);
+            }
+        }
+
+        //A flat table replaces the collider map lookup per cell
+        std::vector<uint8_t> solidGids;
+        if (!options.anyTileIsSolid && !level.tilesetColliders.empty())
+        {
+            solidGids.resize(static_cast<size_t>(level.tilesetColliders.rbegin()->first) + 1, 0);
+            for (const auto& colliders : level.tilesetColliders)
+            {
+                if (colliders.first >= 0 && !colliders.second.empty()) solidGids[colliders.first] = 1;
+            }
+        }
+
+        for (const Layer* layer : layers)
+            layer->decodeAllChunks();
+
+        auto buildRows = [&](int rowStart, int rowEnd) {
+            for (int y = rowStart; y < rowEnd; y++)
+            {
+                for (int x = left; x < right; x++)
+                {
+                    bool solid = false;
+                    for (const Layer* layer : layers)
+                    {
+                        uint32_t gid = static_cast<uint32_t>(layer->getTile(x, y)) & 0x0FFFFFFF;
+                        if (!gid) continue;
+
+                        solid = options.anyTileIsSolid || (gid < solidGids.size() && solidGids[gid]);
+                        if (solid) break;
+                    }
+                    grid.SetSolid(x, y, solid);
+                }
+            }
+        };
+
+        //Rows own whole words, so bands of rows can be written concurrently
+        const size_t cells = static_cast<size_t>(right - left) * (bottom - top);
+        const size_t threadCount = std::min<size_t>(options.threadCount ? options.threadCount : std::max(1u, std::thread::hardware_concurrency()), bottom - top);
+        if (threadCount <= 1 || cells < 64 * 1024)
+        {
+            buildRows(top, bottom);
+            return;
+        }
+
+        ThreadPool pool(threadCount);
+        std::vector<std::future<void>> pending;
+        for (size_t band = 0; band < threadCount; band++)
+        {
+            int rowStart = top + static_cast<int>((static_cast<int64_t>(bottom - top) * band) / threadCount);
+            int rowEnd = top + static_cast<int>((static_cast<int64_t>(bottom - top) * (band + 1)) / threadCount);
+            pending.push_back(pool.Enqueue([&buildRows, rowStart, rowEnd]() { buildRows(rowStart, rowEnd); }));
+        }
+        for (std::future<void>& rows : pending)
+            rows.get();
+    }
+
+    // Builds a grid covering every chosen layer, including all chunks of infinite layers
+    inline WalkabilityGrid BuildWalkabilityGrid(const Level& level, const WalkabilityOptions& options = {})
+    {
+        int minX = std::numeric_limits<int>::max(), minY = std::numeric_limits<int>::max();
+        int maxX = std::numeric_limits<int>::min(), maxY = std::numeric_limits<int>::min();
+        for (size_t i = 0; i < level.layers.size(); i++)
+        {
+            if (!options.layers.empty() && std::find(options.layers.begin(), options.layers.end(), i) == options.layers.end()) continue;
+
+            SDL_Rect bounds = GetLayerBounds(level.layers[i]);
+            if (!bounds.w || !bounds.h) continue;
+            minX = std::min(minX, bounds.x);
+            minY = std::min(minY, bounds.y);
+            maxX = std::max(maxX, bounds.x + bounds.w);
+            maxY = std::max(maxY, bounds.y + bounds.h);
+        }
+        if (minX >= maxX || minY >= maxY) return WalkabilityGrid();
+
+        WalkabilityGrid grid(minX, minY, maxX - minX, maxY - minY);
+        RefreshWalkabilityGrid(grid, level, options, { minX, minY, maxX - minX, maxY - minY });
+        return grid;
+    }
+
+
+    /// 
+    ///  RESULTS OF LOADING SEVERAL LEVELS AT ONCE
+    /// 
+
+    struct LevelResult
+    {
+        std::filesystem::path path;
+        std::unique_ptr<Level> level;   // Null if the load failed
+        std::string error;
+    };
+
+    struct BatchResult
+    {
+        std::vector<LevelResult> levels;    // In the order the paths were given
+        double wallSeconds = 0.0;           // Time from the call to the last texture being created
+        double workSeconds = 0.0;           // Sum of every level's LoadStats::totalSeconds
+
+        size_t failedCount() const
+        {
+            return std::count_if(levels.begin(), levels.end(), [](const LevelResult& result) { return !result.level; });
+        }
+
+        // How many times faster than loading the same levels one after another. Each level's time is wall time on its
+        // worker, so with more workers than free cores this overstates the speedup.
+        double speedup() const { return wallSeconds > 0.0 ? workSeconds / wallSeconds : 0.0; }
+    };
+
+
+    /// 
+    ///  LEVEL LOADER. EXTRACTS TILEMAP DATA FROM .TMX FILES
+    /// 
+
+    // A loading context with no global state: it owns its renderer (or none), its worker threads, its XML scratch
+    // buffers and a cache of parsed external tilesets. Any number of loaders can run at once, and one loader can be
+    // used from several threads at a time.
+    class Loader
+    {
+    public:
+        // With a null renderer no textures are created, which is safe off the main thread. TilesetData::imagePath can
+        // then be used to upload them later. threadCount is the size of the worker pool, 0 for one per core. Workers
+        // are only started the first time the pool is used.
+        explicit Loader(SDL_Renderer* renderer = nullptr, size_t threadCount = 0)
+            : mRenderer(renderer), mThreadCount(threadCount), mOwnedDocuments(std::make_unique<XmlDocumentPool>()), mDocuments(*mOwnedDocuments) {}
+
+        Loader(const Loader&) = delete;
+        Loader& operator=(const Loader&) = delete;
+
+        // Loads lvlPath/<name>/<name>.tmx, where lvlPath is the level directory
+        void OpenLevel(const std::filesystem::path& lvlPath, Level& level);
+
+        // Loads a .tmx file by path, resolving tilesets relative to its directory
+        void OpenMap(const std::filesystem::path& tmxPath, Level& level);
+
+        // Same as OpenMap, but reads the file through a fixed size block instead of loading it whole. Layer data is
+        // decoded into the layers as it is read, so peak memory is the level itself plus the block and the largest
+        // element other than a layer (a tileset or object group).
+        void StreamMap(const std::filesystem::path& tmxPath, Level& level, size_t blockSize = 64 * 1024);
+
+        // Load many levels in parallel on the thread pool. A .tsx shared between the levels is parsed once and an image
+        // shared between them is decoded once. Textures are created afterwards on the calling thread, one per level, so
+        // each level still owns its textures. Failed loads are reported in the result rather than thrown. Called from a
+        // task on this loader's own pool, the levels are loaded one after another on that thread instead.
+        BatchResult OpenLevels(const std::vector<std::filesystem::path>& lvlPaths);
+        BatchResult OpenMaps(const std::vector<std::filesystem::path>& tmxPaths);
+
+        // With lazy textures, loads leave each tileset's texture deferred until Image::GetTexture is first called for it.
+        // Set before loading.
+        void SetLazyTextures(bool lazy) { mLazyTextures = lazy; }
+
+        // Builds Level::walkability from the chosen collision layers as each level is loaded, once its tilesets'
+        // colliders are known. Set before loading.
+        void SetWalkability(const WalkabilityOptions& options) { mWalkability = options; }
+
+        // Starts decoding a deferred tileset image on the thread pool, so that drawing it only needs the upload
+        void Prefetch(const TilesetData& tileset)
+        {
+            if (!tileset.deferred) return;
+            GetThreadPool().Enqueue([deferred = tileset.deferred]() { deferred->Decode(); });
+        }
+
+        SDL_Renderer* GetRenderer() const { return mRenderer; }
+
+        ThreadPool& GetThreadPool()
+        {
+            std::call_once(mPoolStarted, [this]() {
+                mPool = std::make_unique<ThreadPool>(mThreadCount ? mThreadCount : std::max(1u, std::thread::hardware_concurrency()));
+            });
+            return *mPool;
+        }
+
+    private:
+        friend class IO;
+        friend class HotReloader;
+
+        // Used by IO, borrows the calling thread's documents so the static API keeps reusing them between calls
+        Loader(SDL_Renderer* renderer, XmlDocumentPool& documents)
+            : mRenderer(renderer), mThreadCount(0), mDocuments(documents) {}
+
+        struct TilesetDefinition;
+        struct DecodedImage;
+        using DecodedImages = std::unordered_map<std::string, std::unique_ptr<DecodedImage>>;
+
+        static std::filesystem::path LevelFile(const std::filesystem::path& lvlPath);
+
+        void ParseMap(const std::filesystem::path& tmxPath, Level& level);
+        void LoadTextures(Level& level, const DecodedImages* decoded = nullptr);
+        void DecodeImages(Level& level, DecodedImages& decoded, std::mutex& mutex);
+        std::shared_ptr<const TilesetDefinition> GetTilesetDefinition(const std::filesystem::path& tileset, LoadStats& stats);
+
+        void GetMap(rapidxml::xml_node<>* mapNode, const std::filesystem::path& lvlPath, Level& level);
+        void GetTileset(rapidxml::xml_node<>* tilesetNode, const std::filesystem::path& lvlPath, Level& level);
+        void GetTileData(const std::filesystem::path& tileset, int firstID, Level& level);
+        void GetTileData(rapidxml::xml_node<>* tilesetNode, int firstID, const std::filesystem::path& pngPath, Level& level);
+
+        static void GetLayer(rapidxml::xml_node<>* layerNode, Layer& layer, PropertyTable& properties);
+        static void StreamLayer(XmlStream& stream, const XmlTag& layerTag, bool infinite, Level& level, XmlDocument& scratch);
+        static void GetObjects(rapidxml::xml_node<>* mapNode, Level& level);
+        static void GetObjectGroup(rapidxml::xml_node<>* group, Level& level);
+
+        static ColliderList GetColliders(rapidxml::xml_node<>* objectGroupNode, std::pmr::memory_resource* resource);
+        static PropertySet GetProperties(rapidxml::xml_node<>* inputNode, PropertyTable& properties);
+        static PropertySet GetPropertySet(rapidxml::xml_node<>* propertiesNode, PropertyTable& properties);
+
+        // Most tiles reserved up front for a dense layer. Layer sizes come from the file, so a larger layer still loads
+        // but grows its buffer as it is decoded.
+        static constexpr size_t MaxReservedTiles = size_t(1) << 24;
+
+        static size_t ReservedTiles(int width, int height)
+        {
+            return width > 0 && height > 0 ? std::min(static_cast<size_t>(width) * static_cast<size_t>(height), MaxReservedTiles) : 0;
+        }
+
+    private:
+        // An external tileset parsed on its own, with tile IDs starting at 0. Reparsed if the file changes.
+        struct TilesetDefinition
+        {
+            std::filesystem::file_time_type writeTime;
+            Level tileset;
+        };
+
+        struct TilesetEntry
+        {
+            std::mutex mutex;
+            std::shared_ptr<const TilesetDefinition> definition;
+        };
+
+        // A tileset image decoded once for every level of a batch that uses it
+        struct DecodedImage
+        {
+            std::once_flag decoded;
+            SDL_Surface* surface = nullptr;
+
+            ~DecodedImage() { SDL_FreeSurface(surface); }
+        };
+
+    private:
+        SDL_Renderer* mRenderer;
+        size_t mThreadCount;
+        bool mLazyTextures = false;
+        std::optional<WalkabilityOptions> mWalkability;
+        std::unique_ptr<XmlDocumentPool> mOwnedDocuments;
+        XmlDocumentPool& mDocuments;
+
+        std::unordered_map<std::string, std::unique_ptr<TilesetEntry>> mTilesets;
+        std::mutex mTilesetMutex;
+
+        std::once_flag mPoolStarted;
+        std::unique_ptr<ThreadPool> mPool;
+    };
+
+    inline void Loader::GetMap(rapidxml::xml_node<>* mapNode, const std::filesystem::path& lvlPath, Level& level)
+    {
+        LoadStats& stats = level.stats;
+        if (rapidxml::xml_attribute<>* tileWidth = mapNode->first_attribute("tilewidth")) level.tileWidth = std::atoi(tileWidth->value());
+        if (rapidxml::xml_attribute<>* tileHeight = mapNode->first_attribute("tileheight")) level.tileHeight = std::atoi(tileHeight->value());
+
+        //One pass over the direct children of <map>, each element goes straight to its handler
+        for (rapidxml::xml_node<>* node = mapNode->first_node(); node; node = node->next_sibling())
+        {
+            auto element = ElementTable.find(NameOf(node));
+            if (element == ElementTable.end()) continue;
+
+            switch (element->second)
+            {
+            case Element::Layer:
+            {
+                StageTimer timer(stats.layerSeconds);
+                Layer& layer = level.layers.emplace_back(0, 0);
+                GetLayer(node, layer, level.properties);
+                stats.tileCount += layer.mElements.size();
+                break;
+            }
+
+            case Element::Tileset:
+            {
+                StageTimer timer(stats.tilesetSeconds);
+                GetTileset(node, lvlPath, level);
+                break;
+            }
+
+            case Element::ObjectGroup:
+            {
+                StageTimer timer(stats.objectSeconds);
+                GetObjectGroup(node, level);
+                break;
+            }
+
+            case Element::Properties:
+                level.mapProperties = GetProperties(mapNode, level.properties);
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        std::sort(level.tilesets.begin(), level.tilesets.end());
+    }
+
+    inline void Loader::GetLayer(rapidxml::xml_node<>* layerNode, Layer& layer, PropertyTable& properties)
+    {
+        TMXTOSDL_PROFILE_SCOPE("Loader::GetLayer");
+        //Each layer carries its own size, which for infinite maps is only the bounds of its chunks
+        int width = std::atoi(layerNode->first_attribute("width")->value());
+        int height = std::atoi(layerNode->first_attribute("height")->value());
+
+        layer.mWidth = width;
+        layer.mHeight = height;
+        layer.setProperties(GetProperties(layerNode, properties));
+
+        //Taken from the map rather than from the chunks, an empty layer of an infinite map has none
+        rapidxml::xml_node<>* mapNode = layerNode->parent();
+        rapidxml::xml_attribute<>* infinite = mapNode ? mapNode->first_attribute("infinite") : nullptr;
+        layer.mInfinite = infinite && ValueOf(infinite) == "1";
+
+        rapidxml::xml_node<>* layerData = layerNode->first_node("data");
+        if (!layerData) return;
+
+        rapidxml::xml_attribute<>* encoding = layerData->first_attribute("encoding");
+        if (encoding && ValueOf(encoding) == "base64")
+        {
+            layer.mEncoding = LayerEncoding::Base64;
+        }
+        else if (!encoding || ValueOf(encoding) != "csv")
+        {
+            std::cout << "Unsupported layer encoding, use CSV or Base64." << std::endl;
+            return;
+        }
+
+        if (rapidxml::xml_attribute<>* compression = layerData->first_attribute("compression"))
+        {
+            std::cout << "Compressed layer data (" << ValueOf(compression) << ") is not supported." << std::endl;
+            return;
+        }
+
+        if (layerData->first_node("chunk"))
+        {
+            //Keep the raw payloads, chunks are only decoded once queried
+            for (rapidxml::xml_node<>* chunk = layerData->first_node("chunk"); chunk; chunk = chunk->next_sibling("chunk"))
+            {
+                layer.addChunk(
+                    std::atoi(chunk->first_attribute("x")->value()),
+                    std::atoi(chunk->first_attribute("y")->value()),
+                    std::atoi(chunk->first_attribute("width")->value()),
+                    std::atoi(chunk->first_attribute("height")->value()),
+                    ValueOf(chunk));
+            }
+        }
+        else
+        {
+            layer.mElements.reserve(ReservedTiles(width, height));
+            DecodeLayerData(layer.mEncoding, ValueOf(layerData), layer.mElements);
+            TMXTOSDL_PROFILE_BYTES(layerData->value_size());
+            TMXTOSDL_PROFILE_TILES(layer.mElements.size());
+        }
+    }
+
+    inline void Loader::GetTileData(const std::filesystem::path& tileset, int firstID, Level& level)
+    {
+        TMXTOSDL_PROFILE_SCOPE("Loader::GetTileData");
+        std::shared_ptr<const TilesetDefinition> definition = GetTilesetDefinition(tileset, level.stats);
+        const Level& parsed = definition->tileset;
+        const TilesetData& parsedData = parsed.tilesets.front();
+
+        //Copy the shared definition in, offsetting its tile IDs by the map's firstgid
+        TilesetData& setData = level.tilesets.emplace_back(parsedData);
+        setData.firstID = firstID;
+        setData.properties = level.properties.copySet(parsed.properties, parsedData.properties);
+
+        for (const auto& colliders : parsed.tilesetColliders)
+            level.tilesetColliders.emplace(firstID + colliders.first, colliders.second);
+
+        for (const auto& properties : parsed.tileProperties)
+            level.tileProperties.emplace(firstID + properties.first, level.properties.copySet(parsed.properties, properties.second));
+    }
+
+    inline std::shared_ptr<const Loader::TilesetDefinition> Loader::GetTilesetDefinition(const std::filesystem::path& tileset, LoadStats& stats)
+    {
+        std::error_code error;
+        std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(tileset, error);
+
+        TilesetEntry* entry = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mTilesetMutex);
+            std::unique_ptr<TilesetEntry>& slot = mTilesets[tileset.lexically_normal().string()];
+            if (!slot) slot = std::make_unique<TilesetEntry>();
+            entry = slot.get();
+        }
+
+        //Maps that need the same tileset while it's being parsed wait for it instead of parsing it again
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (entry->definition && !error && entry->definition->writeTime == writeTime) return entry->definition;
+
+        TMXTOSDL_PROFILE_SCOPE("Loader::ParseTileset");
+        auto definition = std::make_shared<TilesetDefinition>();
+        definition->writeTime = writeTime;
+
+        XmlDocument doc(mDocuments);
+        stats.fileBytes += doc.Read(tileset);
+        TMXTOSDL_PROFILE_BYTES(doc.GetSize());
+        doc.Parse();
+
+        rapidxml::xml_node<>* tilesetNode = doc.FirstNode("tileset");
+        if (!tilesetNode) throw std::runtime_error("missing <tileset> element in " + tileset.string());
+
+        //Image path is relative to the .tsx file
+        GetTileData(tilesetNode, 0, tileset.parent_path(), definition->tileset);
+        definition->tileset.tilesets.front().source = tileset;
+
+        entry->definition = definition;
+        return definition;
+    }
+
+    inline void Loader::GetTileData(rapidxml::xml_node<>* tilesetNode, int firstID, const std::filesystem::path& pngPath, Level& level)
+    {
+        TMXTOSDL_PROFILE_SCOPE("Loader::GetTileData");
+        int tileWidth = std::atoi(tilesetNode->first_attribute("tilewidth")->value());
+        int tileHeight = std::atoi(tilesetNode->first_attribute("tileheight")->value());
+        int tilesetWidth = std::atoi(tilesetNode->first_attribute("columns")->value());
+
+        TilesetData& setData = level.tilesets.emplace_back(firstID, nullptr, tileWidth, tileHeight, tilesetWidth);
+        std::pmr::memory_resource* resource = level.tilesetColliders.get_allocator().resource();
+
+        //One pass over the direct children of <tileset>
+        for (rapidxml::xml_node<>* node = tilesetNode->first_node(); node; node = node->next_sibling())
+        {
+            auto element = ElementTable.find(NameOf(node));
+            if (element == ElementTable.end()) continue;
+
+            switch (element->second)
+            {
+            case Element::Image:
+            {
+                //Collection tilesets have an image per tile instead, which isn't supported
+                rapidxml::xml_attribute<>* source = node->first_attribute("source");
+                if (!source) break;
+
+                //Textures are created once the whole map is parsed, see LoadTextures
+                std::string unescaped;
+                setData.imagePath = pngPath / UnescapeXml(ValueOf(source), unescaped);
+                break;
+            }
+
+            case Element::Tile:
+            {
+                int tileID = std::atoi(node->first_attribute("id")->value());
+
+                if (rapidxml::xml_node<>* objectGroup = node->first_node("objectgroup"))
+                    level.tilesetColliders.emplace(firstID + tileID, GetColliders(objectGroup, resource));
+
+                if (PropertySet tileProperties = GetProperties(node, level.properties))
+                    level.tileProperties.emplace(firstID + tileID, tileProperties);
+                break;
+            }
+
+            case Element::Properties:
+                setData.properties = GetProperties(tilesetNode, level.properties);
+                break;
+
+            default:
+                break;
+            }
+        }
+    }
+
+    inline void Loader::GetTileset(rapidxml::xml_node<>* tilesetNode, const std::filesystem::path& lvlPath, Level& level)
+    {
+        int firstGridID = std::atoi(tilesetNode->first_attribute("firstgid")->value());
+
+        //Some tilesets are included inline in file, some stored externally. 
+        if (rapidxml::xml_attribute<>* source = tilesetNode->first_attribute("source"))
+        {
+            std::string unescaped;
+            GetTileData(lvlPath / UnescapeXml(ValueOf(source), unescaped), firstGridID, level);
+        }
+        else
+        {
+            GetTileData(tilesetNode, firstGridID, lvlPath, level);
+        }
+    }
+
+    inline ColliderList Loader::GetColliders(rapidxml::xml_node<>* objectGroupNode, std::pmr::memory_resource* resource)
+    {
+        //Initialise vector to return
+        ColliderList returnColliders(resource);
+
+        // cycles every collider in group
+        for (rapidxml::xml_node<>* collider = objectGroupNode->first_node("object"); collider; collider = collider->next_sibling("object"))
+        {
+            int x = 0, y = 0, w = 0, h = 0;
+            std::string attrName;
+
+            // Cycles every attribute of the collider
+            for (rapidxml::xml_attribute<>* nodeAttr = collider->first_attribute("x"); nodeAttr; nodeAttr = nodeAttr->next_attribute())
+            {
+                attrName = NameOf(nodeAttr);
+                double fAttr = std::atof(nodeAttr->value());
+                int attr = static_cast<int>(round(fAttr));
+
+                if (AttributeTable.count(attrName) == 0) continue;
+
+                switch (AttributeTable.at(attrName))
+                {
+                case Attribute::X:
+                    x = attr;
+                    break;
+
+                case Attribute::Y:
+                    y = attr;
+                    break;
+
+                case Attribute::Width:
+                    w = attr;
+                    break;
+
+                case Attribute::Height:
+                    h = attr;
+                    break;
+
+                default:
+                    break;
+                }
+            }
+            returnColliders.push_back({ x, y, w, h });
+        }
+        return returnColliders;
+    }
+
+    inline PropertySet Loader::GetProperties(rapidxml::xml_node<>* inputNode, PropertyTable& properties)
+    {
+        //Only the node's own <properties> child, not those of nested elements
+        rapidxml::xml_node<>* propertiesNode = inputNode->first_node("properties");
+        return propertiesNode ? GetPropertySet(propertiesNode, properties) : 0;
+    }
+
+    inline PropertySet Loader::GetPropertySet(rapidxml::xml_node<>* propertiesNode, PropertyTable& properties)
+    {
+        PropertySet set = properties.openSet();
+        for (rapidxml::xml_node<>* property = propertiesNode->first_node("property"); property; property = property->next_sibling("property"))
+        {
+            rapidxml::xml_attribute<>* name = property->first_attribute("name");
+            rapidxml::xml_attribute<>* type = property->first_attribute("type");
+            rapidxml::xml_attribute<>* value = property->first_attribute("value");
+            if (!name) continue;
+
+            // Multi-line string properties store their value as text content instead
+            std::string nameBuffer, valueBuffer;
+            properties.add(set, UnescapeXml(ValueOf(name), nameBuffer), type ? ValueOf(type) : std::string_view(),
+                UnescapeXml(value ? ValueOf(value) : ValueOf(property), valueBuffer));
+        }
+        return set;
+    }
+
+    inline void Loader::GetObjects(rapidxml::xml_node<>* mapNode, Level& level)
+    {
+        //Only direct children of the map, so tile collision groups inside tilesets are never picked up
+        for (rapidxml::xml_node<>* group = mapNode->first_node("objectgroup"); group; group = group->next_sibling("objectgroup"))
+            GetObjectGroup(group, level);
+    }
+
+    inline void Loader::GetObjectGroup(rapidxml::xml_node<>* group, Level& level)
+    {
+        TMXTOSDL_PROFILE_SCOPE("Loader::GetObjectGroup");
+        ObjectData& objects = level.objects;
+
+        //Grow the columns once per group, geometrically so many small groups stay linear
+        size_t objectCount = objects.size();
+        for (rapidxml::xml_node<>* object = group->first_node("object"); object; object = object->next_sibling("object"))
+            objectCount++;
+        if (objectCount > objects.id.capacity())
+            objects.reserve(std::max(objectCount, objects.id.capacity() * 2));
+
+        ObjectGroup groupData;
+        rapidxml::xml_attribute<>* groupName = group->first_attribute("name");
+        rapidxml::xml_attribute<>* groupID = group->first_attribute("id");
+        std::string unescaped;
+        groupData.name = groupName ? UnescapeXml(ValueOf(groupName), unescaped) : std::string_view();
+        groupData.id = groupID ? std::atoi(groupID->value()) : 0;
+        groupData.first = objects.size();
+
+        for (rapidxml::xml_node<>* object = group->first_node("object"); object; object = object->next_sibling("object"))
+        {
+            int id = 0;
+            uint16_t type = 0;
+            float x = 0.0f, y = 0.0f, w = 0.0f, h = 0.0f, rotation = 0.0f;
+            uint32_t gid = 0;
+
+            // Single pass over the attributes of the object
+            for (rapidxml::xml_attribute<>* nodeAttr = object->first_attribute(); nodeAttr; nodeAttr = nodeAttr->next_attribute())
+            {
+                auto attrType = AttributeTable.find(std::string(NameOf(nodeAttr)));
+                if (attrType == AttributeTable.end()) continue;
+
+                switch (attrType->second)
+                {
+                case Attribute::ID:
+                    id = std::atoi(nodeAttr->value());
+                    break;
+
+                case Attribute::Type:
+                    type = objects.internType(UnescapeXml(ValueOf(nodeAttr), unescaped));
+                    break;
+
+                case Attribute::X:
+                    x = std::strtof(nodeAttr->value(), nullptr);
+                    break;
+
+                case Attribute::Y:
+                    y = std::strtof(nodeAttr->value(), nullptr);
+                    break;
+
+                case Attribute::Width:
+                    w = std::strtof(nodeAttr->value(), nullptr);
+                    break;
+
+                case Attribute::Height:
+                    h = std::strtof(nodeAttr->value(), nullptr);
+                    break;
+
+                case Attribute::Rotation:
+                    rotation = std::strtof(nodeAttr->value(), nullptr);
+                    break;
+
+                case Attribute::GID:
+                    // Flip flags live in the top bits, so this must be read unsigned
+                    gid = static_cast<uint32_t>(std::strtoul(nodeAttr->value(), nullptr, 10));
+                    break;
+
+                default:
+                    break;
+                }
+            }
+
+            PropertySet properties = GetProperties(object, level.properties);
+
+            objects.id.push_back(id);
+            objects.type.push_back(type);
+            objects.x.push_back(x);
+            objects.y.push_back(y);
+            objects.width.push_back(w);
+            objects.height.push_back(h);
+            objects.rotation.push_back(rotation);
+            objects.gid.push_back(gid);
+            objects.properties.push_back(properties);
+        }
+
+        groupData.count = objects.size() - groupData.first;
+        objects.groups.push_back(std::move(groupData));
+    }
+
+    inline void Loader::OpenLevel(const std::filesystem::path& lvlPath, Level& level)
+    {
+        TMXTOSDL_PROFILE_SCOPE("Loader::OpenLevel");
+        OpenMap(LevelFile(lvlPath), level);
+    }
+
+    inline std::filesystem::path Loader::LevelFile(const std::filesystem::path& lvlPath)
+    {
+        std::filesystem::path lvlName = lvlPath.parent_path().filename();
+        std::filesystem::path lvlLoc = lvlPath;
+        lvlLoc /= lvlName;
+        lvlLoc += ".tmx";
+        return lvlLoc;
+    }
+
+    inline void Loader::OpenMap(const std::filesystem::path& tmxPath, Level& level)
+    {
+        TMXTOSDL_PROFILE_SCOPE("Loader::OpenMap");
+        {
+            StageTimer totalTimer(level.stats.totalSeconds);
+            ParseMap(tmxPath, level);
+            LoadTextures(level);
+        }
+        level.stats.peakBytes = level.stats.parseBytes + GetMemoryReport(level).residentBytes();
+    }
+
+    inline void Loader::ParseMap(const std::filesystem::path& tmxPath, Level& level)
+    {
+        LoadStats& stats = level.stats;
+        LoadMemory& memory = LoadMemory::Get();
+        memory = LoadMemory();
+
+        std::optional<XmlDocument> doc;
+        doc.emplace(mDocuments);
+        {
+            TMXTOSDL_PROFILE_SCOPE("ReadFile");
+            StageTimer timer(stats.readSeconds);
+            stats.fileBytes += doc->Read(tmxPath);
+            TMXTOSDL_PROFILE_BYTES(doc->GetSize());
+        }
+        {
+            TMXTOSDL_PROFILE_SCOPE("ParseXML");
+            TMXTOSDL_PROFILE_BYTES(doc->GetSize());
+            StageTimer timer(stats.parseSeconds);
+            doc->Parse();
+        }
+
+        rapidxml::xml_node<>* mapNode = doc->FirstNode("map");
+        if (!mapNode) throw std::runtime_error("missing <map> element in " + tmxPath.string());
+        GetMap(mapNode, tmxPath.parent_path(), level);
+        if (mWalkability) level.walkability = BuildWalkabilityGrid(level, *mWalkability);
+
+        //Release the document before measuring, so the peak includes it but the level's report doesn't
+        doc.reset();
+        stats.parseBytes = memory.peak;
+    }
+
+    inline void Loader::LoadTextures(Level& level, const DecodedImages* decoded)
+    {
+        if (!mRenderer) return;
+
+        StageTimer timer(level.stats.imageSeconds);
+        for (TilesetData& tileset : level.tilesets)
+        {
+            if (tileset.imagePath.empty() || tileset.tilesetTex) continue;
+
+            if (mLazyTextures)
+            {
+                tileset.deferred = std::make_shared<DeferredTexture>(tileset.imagePath, mRenderer);
+                continue;
+            }
+
+            const DecodedImage* image = nullptr;
+            if (decoded)
+            {
+                auto it = decoded->find(tileset.imagePath.lexically_normal().string());
+                if (it != decoded->end()) image = it->second.get();
+            }
+
+            if (!image)
+            {
+                tileset.tilesetTex = Image::LoadTex(tileset.imagePath.string().c_str(), mRenderer);
+            }
+            else if (image->surface)
+            {
+                tileset.tilesetTex = SDL_CreateTextureFromSurface(mRenderer, image->surface);
+                if (!tileset.tilesetTex) std::cout << SDL_GetError() << std::endl;
+            }
+        }
+    }
+
+    inline void Loader::DecodeImages(Level& level, DecodedImages& decoded, std::mutex& mutex)
+    {
+        StageTimer timer(level.stats.imageSeconds);
+        for (const TilesetData& tileset : level.tilesets)
+        {
+            if (tileset.imagePath.empty()) continue;
+
+            DecodedImage* image = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::unique_ptr<DecodedImage>& slot = decoded[tileset.imagePath.lexically_normal().string()];
+                if (!slot) slot = std::make_unique<DecodedImage>();
+                image = slot.get();
+            }
+
+            //Only the first level to reach the image decodes it, any others wait for it
+            std::call_once(image->decoded, [&]() {
+                TMXTOSDL_PROFILE_SCOPE("IMG_Load");
+                image->surface = IMG_Load(tileset.imagePath.string().c_str());
+                if (!image->surface) std::cout << "Could not load textures." << std::endl;
+            });
+        }
+    }
+
+    inline BatchResult Loader::OpenLevels(const std::vector<std::filesystem::path>& lvlPaths)
+    {
+        std::vector<std::filesystem::path> tmxPaths;
+        tmxPaths.reserve(lvlPaths.size());
+        for (const std::filesystem::path& lvlPath : lvlPaths)
+            tmxPaths.push_back(LevelFile(lvlPath));
+
+        return OpenMaps(tmxPaths);
+    }
+
+    inline BatchResult Loader::OpenMaps(const std::vector<std::filesystem::path>& tmxPaths)
+    {
+        TMXTOSDL_PROFILE_SCOPE("Loader::OpenMaps");
+        const auto start = std::chrono::steady_clock::now();
+
+        BatchResult batch;
+        batch.levels.resize(tmxPaths.size());
+
+        DecodedImages decoded;
+        std::mutex decodedMutex;
+
+        auto load = [this, &decoded, &decodedMutex](LevelResult& result) {
+            auto level = std::make_unique<Level>();
+            try
+            {
+                StageTimer totalTimer(level->stats.totalSeconds);
+                ParseMap(result.path, *level);
+                if (mRenderer && !mLazyTextures) DecodeImages(*level, decoded, decodedMutex);
+                result.level = std::move(level);
+            }
+            catch (const std::exception& e)
+            {
+                result.error = e.what();
+            }
+        };
+
+        //Parse and decode on the workers, the renderer is only used on this thread. A worker waiting on the others
+        //could deadlock the pool, so one loads the batch itself.
+        ThreadPool& pool = GetThreadPool();
+        const bool loadInline = pool.IsWorkerThread();
+        std::vector<std::future<void>> pending;
+        pending.reserve(loadInline ? 0 : tmxPaths.size());
+        for (size_t i = 0; i < tmxPaths.size(); i++)
+        {
+            LevelResult& result = batch.levels[i];
+            result.path = tmxPaths[i];
+            if (loadInline) load(result);
+            else pending.push_back(pool.Enqueue([&load, &result]() { load(result); }));
+        }
+
+        for (std::future<void>& load : pending)
+            load.get();
+
+        for (LevelResult& result : batch.levels)
+        {
+            if (!result.level) continue;
+
+            LoadStats& stats = result.level->stats;
+            {
+                StageTimer totalTimer(stats.totalSeconds);
+                LoadTextures(*result.level, &decoded);
+            }
+            stats.peakBytes = stats.parseBytes + GetMemoryReport(*result.level).residentBytes();
+            batch.workSeconds += stats.totalSeconds;
+        }
+
+        batch.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return batch;
+    }
+
+    inline void Loader::StreamMap(const std::filesystem::path& tmxPath, Level& level, size_t blockSize)
+    {
+        TMXTOSDL_PROFILE_SCOPE("Loader::StreamMap");
+        LoadStats& stats = level.stats;
+        const LoadStats before = stats;
+        const auto start = std::chrono::steady_clock::now();
+
+        LoadMemory& memory = LoadMemory::Get();
+        memory = LoadMemory();
+
+        const std::filesystem::path lvlPath = tmxPath.parent_path();
+        {
+            XmlStream stream(tmxPath, blockSize, stats.readSeconds);
+            XmlDocument scratch(mDocuments);
+            XmlTag tag;
+            std::string element;
+
+            bool foundMap = false;
+            while (!foundMap && stream.NextTag(tag))
+                foundMap = tag.kind == XmlTag::Kind::Open && tag.name() == "map";
+            if (!foundMap) throw std::runtime_error("missing <map> element in " + tmxPath.string());
+            level.tileWidth = std::atoi(tag.attribute("tilewidth").data());
+            level.tileHeight = std::atoi(tag.attribute("tileheight").data());
+            const bool infinite = tag.attribute("infinite") == "1";
+
+            //Same dispatch as GetMap, except that layers are decoded straight from the stream and everything
+            //else is small enough to be read whole and handed to the usual handlers
+            while (stream.NextTag(tag) && tag.kind != XmlTag::Kind::Close)
+            {
+                if (tag.kind == XmlTag::Kind::Other) continue;
+
+                auto type = ElementTable.find(tag.name());
+                if (type == ElementTable.end())
+                {
+                    stream.ReadElement(tag, nullptr);
+                    continue;
+                }
+
+                if (type->second == Element::Layer)
+                {
+                    //Blocks read while decoding count as reading, not as layer time
+                    double readSeconds = stats.readSeconds;
+                    {
+                        StageTimer timer(stats.layerSeconds);
+                        StreamLayer(stream, tag, infinite, level, scratch);
+                    }
+                    stats.layerSeconds -= stats.readSeconds - readSeconds;
+                    continue;
+                }
+
+                stream.ReadElement(tag, &element);
+                scratch.Assign(element);
+                scratch.Parse();
+                rapidxml::xml_node<>* node = scratch.FirstNode();
+
+                switch (type->second)
+                {
+                case Element::Tileset:
+                {
+                    StageTimer timer(stats.tilesetSeconds);
+                    GetTileset(node, lvlPath, level);
+                    break;
+                }
+
+                case Element::ObjectGroup:
+                {
+                    StageTimer timer(stats.objectSeconds);
+                    GetObjectGroup(node, level);
+                    break;
+                }
+
+                case Element::Properties:
+                    level.mapProperties = GetPropertySet(node, level.properties);
+                    break;
+
+                default:
+                    break;
+                }
+            }
+            stats.fileBytes += stream.GetBytesRead();
+        }
+        std::sort(level.tilesets.begin(), level.tilesets.end());
+        if (mWalkability) level.walkability = BuildWalkabilityGrid(level, *mWalkability);
+        LoadTextures(level);
+
+        //Reading and tokenising are interleaved, so parse time is whatever the other stages don't account for
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.totalSeconds += elapsed;
+        stats.parseSeconds += elapsed - ((stats.readSeconds - before.readSeconds) + (stats.layerSeconds - before.layerSeconds)
+            + (stats.tilesetSeconds - before.tilesetSeconds) + (stats.imageSeconds - before.imageSeconds) + (stats.objectSeconds - before.objectSeconds));
+
+        stats.parseBytes = memory.peak;
+        stats.peakBytes = memory.peak + GetMemoryReport(level).residentBytes();
+    }
+
+    inline void Loader::StreamLayer(XmlStream& stream, const XmlTag& layerTag, bool infinite, Level& level, XmlDocument& scratch)
+    {
+        TMXTOSDL_PROFILE_SCOPE("Loader::StreamLayer");
+        Layer& layer = level.layers.emplace_back(0, 0);
+        const int width = std::atoi(layerTag.attribute("width").data());
+        const int height = std::atoi(layerTag.attribute("height").data());
+        layer.mWidth = width;
+        layer.mHeight = height;
+        layer.mInfinite = infinite;
+        if (layerTag.kind != XmlTag::Kind::Open) return;
+
+        XmlTag tag;
+        std::string element;
+        std::string chunkData;
+        while (stream.NextTag(tag) && tag.kind != XmlTag::Kind::Close)
+        {
+            if (tag.kind == XmlTag::Kind::Other) continue;
+
+            if (tag.name() == "properties")
+            {
+                stream.ReadElement(tag, &element);
+                scratch.Assign(element);
+                scratch.Parse();
+                layer.setProperties(GetPropertySet(scratch.FirstNode(), level.properties));
+                continue;
+            }
+
+            if (tag.name() != "data" || tag.kind != XmlTag::Kind::Open)
+            {
+                stream.ReadElement(tag, nullptr);
+                continue;
+            }
+
+            std::string_view encoding = tag.attribute("encoding");
+            if (encoding == "base64")
+            {
+                layer.mEncoding = LayerEncoding::Base64;
+            }
+            else if (encoding != "csv")
+            {
+                std::cout << "Unsupported layer encoding, use CSV or Base64." << std::endl;
+                stream.ReadElement(tag, nullptr);
+                continue;
+            }
+
+            if (std::string_view compression = tag.attribute("compression"); !compression.empty())
+            {
+                std::cout << "Compressed layer data (" << compression << ") is not supported." << std::endl;
+                stream.ReadElement(tag, nullptr);
+                continue;
+            }
+
+            //Dense payloads go straight into the layer, chunk payloads are kept raw as in GetLayer. The size of an
+            //infinite layer is the bounding box of its chunks, which a sparse map never fills.
+            if (!infinite) layer.mElements.reserve(ReservedTiles(width, height));
+            LayerDataDecoder decoder(layer.mEncoding, layer.mElements);
+            while (true)
+            {
+                stream.ReadText([&decoder](std::string_view text) { decoder.Feed(text); });
+                if (!stream.NextTag(tag) || tag.kind == XmlTag::Kind::Close) break;
+                if (tag.kind == XmlTag::Kind::Other) continue;
+
+                if (tag.name() != "chunk" || tag.kind != XmlTag::Kind::Open)
+                {
+                    stream.ReadElement(tag, nullptr);
+                    continue;
+                }
+
+                int x = std::atoi(tag.attribute("x").data());
+                int y = std::atoi(tag.attribute("y").data());
+                int width = std::atoi(tag.attribute("width").data());
+                int height = std::atoi(tag.attribute("height").data());
+
+                chunkData.clear();
+                stream.ReadText([&chunkData](std::string_view text) { chunkData.append(text); });
+                stream.NextTag(tag);
+                layer.addChunk(x, y, width, height, chunkData);
+            }
+            decoder.Finish();
+            level.stats.tileCount += layer.mElements.size();
+        }
+        TMXTOSDL_PROFILE_TILES(layer.mElements.size());
+    }
+
+    /// 
+    ///  STATIC FILE IO INTERFACE
+    /// 
+
+    // The original static API, kept as thin wrappers over a Loader. SetRenderer stores one renderer for the whole
+    // program, so code that loads from several threads or for several renderers should use a Loader of its own.
+    class IO
+    {
+    public:
+        static void SetRenderer(SDL_Renderer* renderer) { mCurrentRenderer = renderer; }
+        static void OpenLevel(const std::filesystem::path& lvlPath, std::vector<Layer>& layerList, std::vector<TilesetData>& tilesetData, std::map<int, ColliderList>& tilesetColliders, SDL_Renderer* renderer = nullptr);
+        static void OpenLevel(const std::filesystem::path& lvlPath, Level& level, SDL_Renderer* renderer = nullptr);
+
+        // Loads a .tmx file by path, resolving tilesets relative to its directory. Unlike OpenLevel this never touches
+        // the renderer set with SetRenderer. With a null renderer no textures are created, which is safe off the
+        // main thread. TilesetData::imagePath can then be used to upload them later.
+        static void OpenMap(const std::filesystem::path& tmxPath, Level& level, SDL_Renderer* renderer)
+        {
+            Loader(renderer, XmlDocumentPool::ForThread()).OpenMap(tmxPath, level);
+        }
+
+        // See Loader::StreamMap
+        static void StreamMap(const std::filesystem::path& tmxPath, Level& level, SDL_Renderer* renderer, size_t blockSize = 64 * 1024)
+        {
+            Loader(renderer, XmlDocumentPool::ForThread()).StreamMap(tmxPath, level, blockSize);
+        }
+
+        // Reads the map layout of a Tiled .world file. Returns false if the file can't be read.
+        static bool OpenWorld(const std::filesystem::path& worldPath, std::vector<WorldMap>& maps);
+
+    private:
+        inline static SDL_Renderer* mCurrentRenderer = nullptr;
+    };
+
+    inline void IO::OpenLevel(const std::filesystem::path& lvlPath, Level& level, SDL_Renderer* renderer)
+    {
+        if (!renderer && !mCurrentRenderer) return;
+        if (renderer) mCurrentRenderer = renderer;
+
+        Loader(mCurrentRenderer, XmlDocumentPool::ForThread()).OpenLevel(lvlPath, level);
+    }
+
+    inline bool IO::OpenWorld(const std::filesystem::path& worldPath, std::vector<WorldMap>& maps)
+    {
+        std::ifstream file(worldPath, std::ios::binary);
+        if (!file) { std::cout << "Could not open world file " << worldPath << "." << std::endl; return false; }
+
+        std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        JsonValue world;
+        if (!JsonValue::Parse(text, world) || world.type != JsonValue::Type::Object)
+        {
+            std::cout << "Could not parse world file " << worldPath << "." << std::endl;
+            return false;
+        }
+
+        //Map file names are relative to the .world file
+        const std::filesystem::path worldDir = worldPath.parent_path();
+
+        if (const JsonValue* mapList = world.find("maps"))
+        {
+            for (const JsonValue& map : mapList->array)
+            {
+                maps.push_back({
+                    worldDir / map.getString("fileName"),
+                    static_cast<int>(map.getNumber("x")),
+                    static_cast<int>(map.getNumber("y")),
+                    static_cast<int>(map.getNumber("width")),
+                    static_cast<int>(map.getNumber("height")) });
+            }
+        }
+
+        //Patterns place every matching file in the world directory on a grid. The map size isn't stored for these,
+        //so each map is assumed to fill one grid cell.
+        if (const JsonValue* patterns = world.find("patterns"))
+        {
+            for (const JsonValue& pattern : patterns->array)
+            {
+                std::regex regex;
+                try { regex.assign(pattern.getString("regexp")); }
+                catch (const std::regex_error&) { std::cout << "Invalid world pattern in " << worldPath << "." << std::endl; continue; }
+
+                int multiplierX = static_cast<int>(pattern.getNumber("multiplierX", 1.0));
+                int multiplierY = static_cast<int>(pattern.getNumber("multiplierY", 1.0));
+                int offsetX = static_cast<int>(pattern.getNumber("offsetX"));
+                int offsetY = static_cast<int>(pattern.getNumber("offsetY"));
+
+                std::error_code error;
+                for (const auto& entry : std::filesystem::directory_iterator(worldDir.empty() ? "." : worldDir, error))
+                {
+                    std::string fileName = entry.path().filename().string();
+                    std::smatch match;
+                    if (!std::regex_match(fileName, match, regex) || match.size() < 3) continue;
+
+                    //A pattern can capture text that isn't a number, or one that doesn't fit. Skip those files.
+                    int cell[2];
+                    bool parsed = true;
+                    for (int i = 0; i < 2 && parsed; i++)
+                    {
+                        const char* first = fileName.data() + match.position(i + 1);
+                        const char* last = first + match.length(i + 1);
+                        auto [end, result] = std::from_chars(first, last, cell[i]);
+                        parsed = result == std::errc() && end == last;
+                    }
+                    if (!parsed) { std::cout << "Could not read the grid position of " << entry.path() << "." << std::endl; continue; }
+
+                    maps.push_back({
+                        entry.path(),
+                        (cell[0] * multiplierX) + offsetX,
+                        (cell[1] * multiplierY) + offsetY,
+                        multiplierX,
+                        multiplierY });
+                }
+            }
+        }
+
+        return true;
+    }
+
+    inline void IO::OpenLevel(const std::filesystem::path& lvlPath, std::vector<Layer>& layerList, std::vector<TilesetData>& tilesetData, std::map<int, ColliderList>& tilesetColliders, SDL_Renderer* renderer)
+    {
+        Level level;
+        OpenLevel(lvlPath, level, renderer);
+
+        layerList.insert(layerList.end(), std::make_move_iterator(level.layers.begin()), std::make_move_iterator(level.layers.end()));
+        tilesetData.insert(tilesetData.end(), level.tilesets.begin(), level.tilesets.end());
+        std::sort(tilesetData.begin(), tilesetData.end());
+        tilesetColliders.insert(std::make_move_iterator(level.tilesetColliders.begin()), std::make_move_iterator(level.tilesetColliders.end()));
+    }
+
+    /// 
+    ///  TILESET IMAGES SHARED BETWEEN LOADED MAPS
+    /// 
+
+    // Reference counted tileset images keyed by path. Images can be decoded on any thread, textures are only created
+    // and destroyed on the thread that calls GetTexture and Release.
+    class TilesetCache
+    {
+    public:
+        TilesetCache() = default;
+        TilesetCache(const TilesetCache&) = delete;
+        TilesetCache& operator=(const TilesetCache&) = delete;
+
+        ~TilesetCache()
+        {
+            for (auto& entry : mEntries)
+            {
+                SDL_FreeSurface(entry.second->surface);
+                SDL_DestroyTexture(entry.second->texture);
+            }
+        }
+
+        // Adds a reference to the image, decoding it if no other map holds it. Thread safe.
+        void Acquire(const std::filesystem::path& image)
+        {
+            Entry* entry = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                std::unique_ptr<Entry>& slot = mEntries[image.lexically_normal().string()];
+                if (!slot) slot = std::make_unique<Entry>();
+                entry = slot.get();
+                entry->references++;
+            }
+
+            //Only the first thread to reach the entry decodes, any others wait for it
+            std::call_once(entry->decoded, [&]() {
+                entry->surface = IMG_Load(image.string().c_str());
+                if (!entry->surface) std::cout << "Could not load textures." << std::endl;
+            });
+        }
+
+        // Returns the texture for an acquired image, uploading and freeing the decoded surface on first use
+        SDL_Texture* GetTexture(const std::filesystem::path& image, SDL_Renderer* renderer)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto it = mEntries.find(image.lexically_normal().string());
+            if (it == mEntries.end()) return nullptr;
+
+            Entry& entry = *it->second;
+            if (!entry.texture && entry.surface && renderer)
+            {
+                entry.texture = SDL_CreateTextureFromSurface(renderer, entry.surface);
+                if (!entry.texture) { std::cout << SDL_GetError() << std::endl; return nullptr; }
+
+                entry.bytes = static_cast<size_t>(entry.surface->w) * entry.surface->h * entry.surface->format->BytesPerPixel;
+                SDL_FreeSurface(entry.surface);
+                entry.surface = nullptr;
+            }
+            return entry.texture;
+        }
+
+        // Drops a reference, destroying the texture once no map holds the image
+        void Release(const std::filesystem::path& image)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto it = mEntries.find(image.lexically_normal().string());
+            if (it == mEntries.end() || --it->second->references > 0) return;
+
+            SDL_FreeSurface(it->second->surface);
+            SDL_DestroyTexture(it->second->texture);
+            mEntries.erase(it);
+        }
+
+        // Bytes held by decoded surfaces and uploaded textures, each shared image counted once
+        size_t GetMemoryUsage() const
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            size_t bytes = 0;
+            for (const auto& entry : mEntries)
+            {
+                if (entry.second->surface)
+                    bytes += static_cast<size_t>(entry.second->surface->h) * entry.second->surface->pitch;
+                else
+                    bytes += entry.second->bytes;
+            }
+            return bytes;
+        }
+
+    private:
+        struct Entry
+        {
+            std::once_flag decoded;
+            SDL_Surface* surface = nullptr;
+            SDL_Texture* texture = nullptr;
+            size_t bytes = 0;
+            int references = 0;
+        };
+
+    private:
+        std::unordered_map<std::string, std::unique_ptr<Entry>> mEntries;
+        mutable std::mutex mMutex;
+    };
+
+
+    /// 
+    ///  TILESET TEXTURES KEPT WITHIN A VRAM BUDGET
+    /// 
+
+    // Owns the tileset textures of the levels adopted into it and keeps their total size within a budget. Textures
+    // that haven't been drawn for longest are evicted first, and are uploaded again the next time they are drawn, from
+    // a retained surface if there is one or by decoding the image again. Tilesets of different levels that use the same
+    // image share one texture. Textures of released levels stay resident until they are evicted, so going back to a
+    // level that was just left usually needs no upload. Use from the render thread only.
+    class TextureResidency
+    {
+    public:
+        // budgetBytes of 0 means no limit. With retainSurfaces each image is kept decoded in system memory once it has
+        // been decoded, so re-uploading an evicted texture skips the decode.
+        TextureResidency(SDL_Renderer* renderer, size_t budgetBytes, bool retainSurfaces = false)
+            : mRenderer(renderer), mBudget(budgetBytes), mRetainSurfaces(retainSurfaces) {}
+
+        ~TextureResidency()
+        {
+            for (Slot& slot : mSlots)
+                SDL_FreeSurface(slot.surface);
+        }
+
+        TextureResidency(const TextureResidency&) = delete;
+        TextureResidency& operator=(const TextureResidency&) = delete;
+
+        // Takes ownership of the level's tileset textures. Their tilesetTex is cleared, draw with GetTexture instead.
+        // Tilesets without a texture, e.g. loaded without a renderer, are uploaded when first drawn.
+        void Adopt(Level& level)
+        {
+            for (TilesetData& tileset : level.tilesets)
+            {
+                if (tileset.textureSlot >= 0 || tileset.imagePath.empty()) continue;
+
+                int index = AcquireSlot(tileset.imagePath);
+                Slot& slot = mSlots[index];
+                if (tileset.tilesetTex && !slot.texture)
+                {
+                    slot.texture.Reset(tileset.tilesetTex);
+                    slot.bytes = TextureBytes(tileset.tilesetTex);
+                    mResidentBytes += slot.bytes;
+                }
+                else if (tileset.tilesetTex && tileset.tilesetTex != slot.texture.Get())
+                {
+                    SDL_DestroyTexture(tileset.tilesetTex);
+                }
+
+                //A deferred texture is replaced by the residency's own upload on first draw
+                tileset.tilesetTex = nullptr;
+                tileset.deferred.reset();
+                tileset.textureSlot = index;
+            }
+            Trim();
+        }
+
+        // Swaps in a reloaded image for an adopted tileset, e.g. from HotReloader. Every tileset sharing the image sees
+        // the new texture. If the tileset's imagePath was changed it moves to the slot of its new image. Takes ownership
+        // of surface, which may be null to upload the image from imagePath when it is next drawn.
+        void Replace(TilesetData& tileset, SDL_Surface* surface)
+        {
+            if (tileset.textureSlot >= 0 && mSlots[tileset.textureSlot].image.lexically_normal() != tileset.imagePath.lexically_normal())
+            {
+                Slot& previous = mSlots[tileset.textureSlot];
+                tileset.textureSlot = -1;
+                if (--previous.references == 0 && !previous.texture) FreeSlot(previous);
+            }
+            if (tileset.imagePath.empty())
+            {
+                SDL_FreeSurface(surface);
+                return;
+            }
+            if (tileset.textureSlot < 0)
+                tileset.textureSlot = AcquireSlot(tileset.imagePath);
+
+            Slot& slot = mSlots[tileset.textureSlot];
+            if (surface)
+            {
+                slot.texture.Reset();
+                mResidentBytes -= slot.bytes;
+                slot.bytes = 0;
+                SDL_FreeSurface(slot.surface);
+                slot.surface = nullptr;
+                Upload(slot, surface);
+            }
+            Trim();
+        }
+
+        // Drops the level's references. Its textures are destroyed once they are evicted.
+        void Release(Level& level)
+        {
+            for (TilesetData& tileset : level.tilesets)
+            {
+                if (tileset.textureSlot < 0) continue;
+
+                Slot& slot = mSlots[tileset.textureSlot];
+                tileset.textureSlot = -1;
+                if (--slot.references == 0 && !slot.texture) FreeSlot(slot);
+            }
+            Trim();
+        }
+
+        // Returns the tileset's texture for drawing, uploading it first if it was evicted. Returns the caller's own
+        // texture for tilesets that were never adopted.
+        SDL_Texture* GetTexture(const TilesetData& tileset)
+        {
+            if (tileset.textureSlot < 0) return tileset.tilesetTex;
+
+            Slot& slot = mSlots[tileset.textureSlot];
+            slot.lastDrawn = mFrame;
+            if (!slot.texture && Upload(slot)) Trim();
+            return slot.texture.Get();
+        }
+
+        // Starts a new frame. Textures drawn during the current frame are never evicted to make room for others, so a
+        // frame that needs more than the budget goes over it rather than uploading the same texture twice.
+        void BeginFrame() { mFrame++; }
+
+        void SetBudget(size_t budgetBytes)
+        {
+            mBudget = budgetBytes;
+            Trim();
+        }
+
+        size_t GetBudget() const { return mBudget; }
+        size_t GetResidentBytes() const { return mResidentBytes; }
+
+        // System memory held by retained surfaces
+        size_t GetRetainedBytes() const
+        {
+            size_t bytes = 0;
+            for (const Slot& slot : mSlots)
+            {
+                if (slot.surface) bytes += static_cast<size_t>(slot.surface->h) * slot.surface->pitch;
+            }
+            return bytes;
+        }
+
+        size_t GetUploadCount() const { return mUploads; }
+        size_t GetEvictionCount() const { return mEvictions; }
+
+    private:
+        struct Slot
+        {
+            std::filesystem::path image;
+            TextureHandle texture;
+            SDL_Surface* surface = nullptr;     // Kept with retainSurfaces
+            size_t bytes = 0;
+            int references = 0;
+            uint64_t lastDrawn = 0;
+        };
+
+        int AllocateSlot()
+        {
+            if (!mFreeSlots.empty())
+            {
+                int index = mFreeSlots.back();
+                mFreeSlots.pop_back();
+                return index;
+            }
+            mSlots.emplace_back();
+            return static_cast<int>(mSlots.size() - 1);
+        }
+
+        // Returns the slot of an image, creating it if needed, and adds a reference to it
+        int AcquireSlot(const std::filesystem::path& image)
+        {
+            std::string key = image.lexically_normal().string();
+            auto it = mSlotsByImage.find(key);
+            if (it == mSlotsByImage.end())
+            {
+                it = mSlotsByImage.emplace(key, AllocateSlot()).first;
+                mSlots[it->second].image = image;
+            }
+
+            mSlots[it->second].references++;
+            return it->second;
+        }
+
+        void FreeSlot(Slot& slot)
+        {
+            mSlotsByImage.erase(slot.image.lexically_normal().string());
+            SDL_FreeSurface(slot.surface);
+            mFreeSlots.push_back(static_cast<int>(&slot - mSlots.data()));
+            slot = Slot();
+        }
+
+        // Uploads decoded if given, otherwise the retained surface or the image decoded again. Takes ownership of decoded.
+        bool Upload(Slot& slot, SDL_Surface* decoded = nullptr)
+        {
+            SDL_Surface* surface = decoded ? decoded : slot.surface;
+            if (!surface)
+            {
+                surface = IMG_Load(slot.image.string().c_str());
+                if (!surface) { std::cout << "Could not load textures." << std::endl; return false; }
+            }
+
+            slot.texture.Reset(SDL_CreateTextureFromSurface(mRenderer, surface));
+            if (mRetainSurfaces) slot.surface = surface;
+            else SDL_FreeSurface(surface);
+            if (!slot.texture) { std::cout << SDL_GetError() << std::endl; return false; }
+
+            slot.bytes = TextureBytes(slot.texture.Get());
+            mResidentBytes += slot.bytes;
+            mUploads++;
+            return true;
+        }
+
+        // Evicts the least recently drawn textures not drawn this frame until the budget is met
+        void Trim()
+        {
+            while (mBudget && mResidentBytes > mBudget)
+            {
+                Slot* oldest = nullptr;
+                for (Slot& slot : mSlots)
+                {
+                    if (slot.texture && slot.lastDrawn < mFrame && (!oldest || slot.lastDrawn < oldest->lastDrawn)) oldest = &slot;
+                }
+                if (!oldest) return;
+
+                oldest->texture.Reset();
+                mResidentBytes -= oldest->bytes;
+                oldest->bytes = 0;
+                mEvictions++;
+                if (oldest->references == 0) FreeSlot(*oldest);
+            }
+        }
+
+    private:
+        SDL_Renderer* mRenderer;
+        size_t mBudget;
+        bool mRetainSurfaces;
+
+        std::vector<Slot> mSlots;
+        std::vector<int> mFreeSlots;
+        std::unordered_map<std::string, int> mSlotsByImage;
+
+        uint64_t mFrame = 1;
+        size_t mResidentBytes = 0;
+        size_t mUploads = 0;
+        size_t mEvictions = 0;
+    };
+
+
+    /// 
+    ///  BACKGROUND STREAMING OF THE MAPS IN A TILED .WORLD FILE
+    /// 
+
+    class WorldStreamer
+    {
+    public:
+        // memoryBudget is in bytes, 0 for unlimited. Maps are parsed and their images decoded on loadThreads workers,
+        // textures are created in Update, so the renderer is only used from the thread that calls Update.
+        WorldStreamer(const std::filesystem::path& worldPath, SDL_Renderer* renderer, size_t memoryBudget = 0, size_t loadThreads = 1)
+            : mRenderer(renderer), mMemoryBudget(memoryBudget), mLoader(nullptr, std::max<size_t>(1, loadThreads))
+        {
+            IO::OpenWorld(worldPath, mMaps);
+            mSlots.resize(mMaps.size());
+        }
+
+        ~WorldStreamer()
+        {
+            for (size_t i = 0; i < mSlots.size(); i++)
+            {
+                Slot& slot = mSlots[i];
+                if (slot.state == State::Loading)
+                {
+                    // Images were acquired on the worker even if the level is thrown away
+                    try { ReleaseTilesets(*slot.pending.get()); }
+                    catch (...) {}
+                }
+                else if (slot.state == State::Loaded)
+                {
+                    ReleaseTilesets(*slot.level);
+                }
+            }
+        }
+
+        WorldStreamer(const WorldStreamer&) = delete;
+        WorldStreamer& operator=(const WorldStreamer&) = delete;
+
+        // Maps whose bounds come within radius world pixels of (x, y) are kept loaded
+        void SetFocus(float x, float y, float radius)
+        {
+            mFocusX = x;
+            mFocusY = y;
+            mRadius = radius;
+        }
+
+        // Call once per frame from the render thread. Finished loads become visible here, maps out of range
+        // are unloaded and new loads are queued nearest first while the memory budget allows. A map that failed to load
+        // is not retried until it has gone out of range and come back.
+        void Update()
+        {
+            std::vector<size_t> wanted;
+            for (size_t i = 0; i < mMaps.size(); i++)
+            {
+                if (DistanceTo(i) <= mRadius) wanted.push_back(i);
+            }
+            std::sort(wanted.begin(), wanted.end(), [this](size_t a, size_t b) { return DistanceTo(a) < DistanceTo(b); });
+
+            for (size_t i = 0; i < mSlots.size(); i++)
+            {
+                Slot& slot = mSlots[i];
+                bool inRange = DistanceTo(i) <= mRadius;
+
+                if (slot.state == State::Loading && slot.pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                    FinishLoad(i, inRange);
+                else if (slot.state == State::Loaded && !inRange)
+                    Unload(i);
+                else if (slot.state == State::Failed && !inRange)
+                    slot.state = State::Unloaded;   //Try again the next time it comes into range, the file may have been fixed
+            }
+
+            //Drop the furthest maps if a finished load pushed usage over budget
+            if (mMemoryBudget)
+            {
+                for (auto it = wanted.rbegin(); it != wanted.rend() && GetMemoryUsage() > mMemoryBudget; ++it)
+                {
+                    if (mSlots[*it].state == State::Loaded && *it != wanted.front()) Unload(*it);
+                }
+            }
+
+            //Loads in flight aren't counted against the budget yet, so keep no more of them than there are workers
+            size_t loading = std::count_if(mSlots.begin(), mSlots.end(), [](const Slot& slot) { return slot.state == State::Loading; });
+            for (size_t index : wanted)
+            {
+                if (loading >= mLoader.GetThreadPool().GetThreadCount()) break;
+                if (mMemoryBudget && GetMemoryUsage() >= mMemoryBudget) break;
+                if (mSlots[index].state != State::Unloaded) continue;
+
+                BeginLoad(index);
+                loading++;
+            }
+        }
+
+        const std::vector<WorldMap>& GetMaps() const { return mMaps; }
+
+        // Returns the level of a map from GetMaps, or nullptr if it isn't resident. Its tileset textures are owned
+        // by the streamer and must not be destroyed with Image::DestroyTilesets.
+        const Level* GetLevel(size_t mapIndex) const
+        {
+            return mSlots[mapIndex].state == State::Loaded ? mSlots[mapIndex].level.get() : nullptr;
+        }
+
+        std::vector<size_t> GetLoadedMaps() const
+        {
+            std::vector<size_t> loaded;
+            for (size_t i = 0; i < mSlots.size(); i++)
+            {
+                if (mSlots[i].state == State::Loaded) loaded.push_back(i);
+            }
+            return loaded;
+        }
+
+        bool IsLoading() const
+        {
+            return std::any_of(mSlots.begin(), mSlots.end(), [](const Slot& slot) { return slot.state == State::Loading; });
+        }
+
+        // Estimated bytes of all resident maps plus their shared tileset images
+        size_t GetMemoryUsage() const { return mLevelBytes + mTilesets.GetMemoryUsage(); }
+
+    private:
+        enum class State { Unloaded, Loading, Loaded, Failed };
+
+        struct Slot
+        {
+            State state = State::Unloaded;
+            std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;     // Backs the level's containers, freed with it
+            std::unique_ptr<Level> level;
+            std::future<std::unique_ptr<Level>> pending;
+            size_t bytes = 0;
+        };
+
+        // Distance from the focus point to the closest point of a map's bounds
+        float DistanceTo(size_t mapIndex) const
+        {
+            const WorldMap& map = mMaps[mapIndex];
+            float dx = std::max({ static_cast<float>(map.x) - mFocusX, 0.0f, mFocusX - static_cast<float>(map.x + map.width) });
+            float dy = std::max({ static_cast<float>(map.y) - mFocusY, 0.0f, mFocusY - static_cast<float>(map.y + map.height) });
+            return std::sqrt((dx * dx) + (dy * dy));
+        }
+
+        void BeginLoad(size_t mapIndex)
+        {
+            Slot& slot = mSlots[mapIndex];
+            slot.state = State::Loading;
+            slot.arena = std::make_unique<std::pmr::monotonic_buffer_resource>();
+            slot.pending = mLoader.GetThreadPool().Enqueue([this, path = mMaps[mapIndex].file, arena = slot.arena.get()]() {
+                auto level = std::make_unique<Level>(arena);
+                mLoader.OpenMap(path, *level);
+
+                for (const TilesetData& tileset : level->tilesets)
+                {
+                    if (!tileset.imagePath.empty()) mTilesets.Acquire(tileset.imagePath);
+                }
+                return level;
+            });
+        }
+
+        void FinishLoad(size_t mapIndex, bool inRange)
+        {
+            Slot& slot = mSlots[mapIndex];
+            try
+            {
+                slot.level = slot.pending.get();
+            }
+            catch (const std::exception& e)
+            {
+                std::cout << "Could not load " << mMaps[mapIndex].file << ": " << e.what() << std::endl;
+                slot.arena.reset();
+                slot.state = State::Failed;
+                return;
+            }
+
+            if (!inRange)
+            {
+                ReleaseTilesets(*slot.level);
+                slot.level.reset();
+                slot.arena.reset();
+                slot.state = State::Unloaded;
+                return;
+            }
+
+            for (TilesetData& tileset : slot.level->tilesets)
+            {
+                if (!tileset.imagePath.empty()) tileset.tilesetTex = mTilesets.GetTexture(tileset.imagePath, mRenderer);
+            }
+
+            slot.bytes = GetMemoryReport(*slot.level).residentBytes();
+            mLevelBytes += slot.bytes;
+            slot.state = State::Loaded;
+        }
+
+        void Unload(size_t mapIndex)
+        {
+            Slot& slot = mSlots[mapIndex];
+            ReleaseTilesets(*slot.level);
+            slot.level.reset();
+            slot.arena.reset();
+            mLevelBytes -= slot.bytes;
+            slot.bytes = 0;
+            slot.state = State::Unloaded;
+        }
+
+        void ReleaseTilesets(const Level& level)
+        {
+            for (const TilesetData& tileset : level.tilesets)
+            {
+                if (!tileset.imagePath.empty()) mTilesets.Release(tileset.imagePath);
+            }
+        }
+
+    private:
+        std::vector<WorldMap> mMaps;
+        std::vector<Slot> mSlots;
+        TilesetCache mTilesets;
+
+        SDL_Renderer* mRenderer;
+        size_t mMemoryBudget;
+        size_t mLevelBytes = 0;
+
+        float mFocusX = 0.0f;
+        float mFocusY = 0.0f;
+        float mRadius = 0.0f;
+
+        // Parses without a renderer on its workers. Declared last so they are joined before the cache and slots they
+        // write to are destroyed.
+        Loader mLoader;
+    };
+
+
+    /// 
+    ///  HOT RELOADING OF EDITED .TMX AND .TSX FILES
+    /// 
+
+    class HotReloader
+    {
+    public:
+        // Watches the map file and the external tilesets and images of a level loaded from tmxPath. Changes are parsed on a
+        // background thread: an edited .tsx reloads only that tileset's texture and colliders, an edited image only its
+        // texture, and an edited .tmx re-decodes only the layers whose contents changed. Uses inotify on Linux and polls
+        // modification times elsewhere.
+        HotReloader(const std::filesystem::path& tmxPath, const Level& level)
+            : mMapPath(Normalise(tmxPath))
+        {
+            for (const TilesetData& tileset : level.tilesets)
+                mTilesets.push_back({ tileset.firstID, tileset.source.empty() ? std::filesystem::path() : Normalise(tileset.source), Normalise(tileset.imagePath) });
+
+            //The initial hashes come from the file on disk, not the level, so edits made before this point are missed
+            try { BuildMapPatch(true); }
+            catch (const std::exception& e) { std::cout << "Could not read " << mMapPath << ": " << e.what() << std::endl; }
+
+            mThread = std::thread([this]() { WatchLoop(); });
+        }
+
+        ~HotReloader()
+        {
+            mStopping = true;
+            mThread.join();
+
+            for (Patch& patch : mPending)
+            {
+                for (TilesetPatch& tileset : patch.tilesets)
+                    SDL_FreeSurface(tileset.surface);
+            }
+        }
+
+        HotReloader(const HotReloader&) = delete;
+        HotReloader& operator=(const HotReloader&) = delete;
+
+        bool HasPending() const
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            return !mPending.empty();
+        }
+
+        // Applies every finished reload to the level in one step. Call between frames from the render thread; replacement
+        // textures are created with renderer and the textures they replace are destroyed. Returns true if the level changed.
+        bool ApplyPending(Level& level, SDL_Renderer* renderer) { return Apply(level, renderer, nullptr); }
+
+        // As above for a level adopted into residency. Reloaded images replace the residency's textures.
+        bool ApplyPending(Level& level, TextureResidency& residency) { return Apply(level, nullptr, &residency); }
+
+    private:
+        bool Apply(Level& level, SDL_Renderer* renderer, TextureResidency* residency)
+        {
+            std::vector<Patch> pending;
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                pending.swap(mPending);
+            }
+
+            for (Patch& patch : pending)
+            {
+                for (TilesetPatch& tileset : patch.tilesets)
+                    ApplyTileset(level, tileset, renderer, residency);
+
+                if (!level.properties.canCopy(patch.parsed.properties))
+                {
+                    std::cout << "Map changes in " << mMapPath << " not applied: a property name has the same hash as another." << std::endl;
+                    continue;
+                }
+
+                //Release the sets being replaced first so the copies reuse their handles and the table stays bounded
+                if (patch.replaceLayers)
+                {
+                    for (const Layer& layer : level.layers)
+                        level.properties.releaseSet(layer.getProperties());
+                    level.layers.clear();
+                }
+                else
+                {
+                    for (const auto& layer : patch.layers)
+                        if (layer.first < level.layers.size()) level.properties.releaseSet(level.layers[layer.first].getProperties());
+                }
+
+                for (auto& layer : patch.layers)
+                {
+                    layer.second.setProperties(level.properties.copySet(patch.parsed.properties, layer.second.getProperties()));
+                    if (patch.replaceLayers)
+                        level.layers.push_back(std::move(layer.second));
+                    else if (layer.first < level.layers.size())
+                        level.layers[layer.first] = std::move(layer.second);
+                }
+
+                if (patch.objectsChanged)
+                {
+                    for (PropertySet properties : level.objects.properties)
+                        level.properties.releaseSet(properties);
+                    level.objects = std::move(patch.parsed.objects);
+                    for (PropertySet& properties : level.objects.properties)
+                        properties = level.properties.copySet(patch.parsed.properties, properties);
+                }
+
+                if (patch.mapPropertiesChanged)
+                {
+                    level.properties.releaseSet(level.mapProperties);
+                    level.mapProperties = level.properties.copySet(patch.parsed.properties, patch.parsed.mapProperties);
+                }
+            }
+
+            return !pending.empty();
+        }
+
+        struct TrackedTileset
+        {
+            int firstID;
+            std::filesystem::path source;
+            std::filesystem::path image;
+        };
+
+        struct TilesetPatch
+        {
+            int firstID;
+            bool imageOnly;
+            TilesetData data;
+            ColliderMap colliders;
+            SDL_Surface* surface = nullptr;
+        };
+
+        struct Patch
+        {
+            std::vector<TilesetPatch> tilesets;
+
+            bool replaceLayers = false;                         // Layer count changed, layers holds every layer in order
+            std::vector<std::pair<size_t, Layer>> layers;       // Changed layers by index
+            bool objectsChanged = false;
+            bool mapPropertiesChanged = false;
+
+            Level parsed;   // Owns the objects and the property table the layers and objects above refer to
+        };
+
+        static std::filesystem::path Normalise(const std::filesystem::path& path)
+        {
+            std::error_code error;
+            std::filesystem::path absolute = std::filesystem::absolute(path, error);
+            return (error ? path : absolute).lexically_normal();
+        }
+
+        // FNV-1a over a node's name, attributes, value and children
+        static uint64_t HashNode(rapidxml::xml_node<>* node, uint64_t hash = 14695981039346656037ull)
+        {
+            auto mix = [&hash](const char* data, size_t size) {
+                for (size_t i = 0; i < size; i++)
+                {
+                    hash ^= static_cast<uint8_t>(data[i]);
+                    hash *= 1099511628211ull;
+                }
+                hash ^= 0xFF;
+                hash *= 1099511628211ull;
+            };
+
+            mix(node->name(), node->name_size());
+            for (rapidxml::xml_attribute<>* attr = node->first_attribute(); attr; attr = attr->next_attribute())
+            {
+                mix(attr->name(), attr->name_size());
+                mix(attr->value(), attr->value_size());
+            }
+            mix(node->value(), node->value_size());
+
+            for (rapidxml::xml_node<>* child = node->first_node(); child; child = child->next_sibling())
+                hash = HashNode(child, hash);
+
+            return hash;
+        }
+
+        void WatchLoop()
+        {
+            std::vector<std::filesystem::path> changed;
+            auto lastEvent = std::chrono::steady_clock::now();
+
+            auto track = [&](const std::filesystem::path& path) {
+                if (std::find(changed.begin(), changed.end(), path) == changed.end())
+                    changed.push_back(path);
+                lastEvent = std::chrono::steady_clock::now();
+            };
+
+            //Wait for the editor to finish writing before parsing
+            auto flush = [&]() {
+                if (!changed.empty() && std::chrono::steady_clock::now() - lastEvent > std::chrono::milliseconds(100))
+                {
+                    ProcessChanges(changed);
+                    changed.clear();
+                }
+            };
+
+#ifdef __linux__
+            int fd = inotify_init1(IN_NONBLOCK);
+            if (fd >= 0)
+            {
+                std::unordered_map<int, std::filesystem::path> watchedDirs;
+                for (const std::filesystem::path& file : GetTrackedFiles())
+                {
+                    std::filesystem::path dir = file.parent_path();
+                    if (std::any_of(watchedDirs.begin(), watchedDirs.end(), [&dir](const auto& watched) { return watched.second == dir; })) continue;
+
+                    // Editors often save by writing a temporary file and renaming it over the original
+                    int wd = inotify_add_watch(fd, dir.string().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+                    if (wd >= 0) watchedDirs.emplace(wd, dir);
+                }
+
+                alignas(inotify_event) char buffer[4096];
+                while (!mStopping)
+                {
+                    pollfd pfd = { fd, POLLIN, 0 };
+                    if (poll(&pfd, 1, 50) > 0)
+                    {
+                        ssize_t length;
+                        while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+                        {
+                            for (char* it = buffer; it < buffer + length; it += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(it)->len)
+                            {
+                                const inotify_event* event = reinterpret_cast<const inotify_event*>(it);
+                                auto dir = watchedDirs.find(event->wd);
+                                if (dir != watchedDirs.end() && event->len > 0)
+                                    track((dir->second / event->name).lexically_normal());
+                            }
+                        }
+                    }
+                    flush();
+                }
+
+                close(fd);
+                return;
+            }
+
+            //Out of inotify instances or unsupported, so poll write times like other platforms
+            std::cout << "Unable to watch for changes with inotify, polling instead" << std::endl;
+#endif
+            std::unordered_map<std::string, std::filesystem::file_time_type> writeTimes;
+            for (const std::filesystem::path& file : GetTrackedFiles())
+            {
+                std::error_code error;
+                writeTimes[file.string()] = std::filesystem::last_write_time(file, error);
+            }
+
+            while (!mStopping)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(250));
+                for (auto& file : writeTimes)
+                {
+                    std::error_code error;
+                    std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(file.first, error);
+                    if (!error && writeTime != file.second)
+                    {
+                        file.second = writeTime;
+                        track(std::filesystem::path(file.first));
+                    }
+                }
+                flush();
+            }
+        }
+
+        std::vector<std::filesystem::path> GetTrackedFiles() const
+        {
+            std::vector<std::filesystem::path> files = { mMapPath };
+            for (const TrackedTileset& tileset : mTilesets)
+            {
+                if (!tileset.source.empty()) files.push_back(tileset.source);
+                if (!tileset.image.empty()) files.push_back(tileset.image);
+            }
+            return files;
+        }
+
+        void ProcessChanges(const std::vector<std::filesystem::path>& changed)
+        {
+            Patch patch;
+
+            try
+            {
+                for (const std::filesystem::path& file : changed)
+                {
+                    if (file == mMapPath)
+                    {
+                        Patch mapPatch = BuildMapPatch(false);
+                        mapPatch.tilesets = std::move(patch.tilesets);
+                        patch = std::move(mapPatch);
+                    }
+
+                    for (const TrackedTileset& tileset : mTilesets)
+                    {
+                        if (file == tileset.source)
+                            patch.tilesets.push_back(BuildTilesetPatch(tileset, false));
+                        else if (file == tileset.image && std::find(changed.begin(), changed.end(), tileset.source) == changed.end())
+                            patch.tilesets.push_back(BuildTilesetPatch(tileset, true));
+                    }
+                }
+            }
+            catch (const std::exception& e)
+            {
+                //Most likely caught the file half written, the next save triggers another reload
+                std::cout << "Could not reload level: " << e.what() << std::endl;
+                for (TilesetPatch& tileset : patch.tilesets)
+                    SDL_FreeSurface(tileset.surface);
+                return;
+            }
+
+            if (patch.tilesets.empty() && patch.layers.empty() && !patch.replaceLayers && !patch.objectsChanged && !patch.mapPropertiesChanged) return;
+
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPending.push_back(std::move(patch));
+        }
+
+        TilesetPatch BuildTilesetPatch(const TrackedTileset& tileset, bool imageOnly)
+        {
+            TilesetPatch patch;
+            patch.firstID = tileset.firstID;
+            patch.imageOnly = imageOnly;
+
+            std::filesystem::path image = tileset.image;
+            if (!imageOnly)
+            {
+                Level parsed;
+                mLoader.GetTileData(tileset.source, tileset.firstID, parsed);
+                patch.data = std::move(parsed.tilesets.front());
+                patch.colliders = std::move(parsed.tilesetColliders);
+                image = Normalise(patch.data.imagePath);
+            }
+
+            if (!image.empty())
+            {
+                patch.surface = IMG_Load(image.string().c_str());
+                if (!patch.surface) std::cout << "Could not load textures." << std::endl;
+            }
+            return patch;
+        }
+
+        // Re-parses the map, decoding only layers whose hash changed. With initialise set it only records the hashes.
+        Patch BuildMapPatch(bool initialise)
+        {
+            Patch patch;
+
+            XmlDocument doc(mLoader.mDocuments);
+            doc.Read(mMapPath);
+            doc.Parse();
+
+            rapidxml::xml_node<>* mapNode = doc.FirstNode("map");
+            if (!mapNode) throw std::runtime_error("missing <map> element");
+
+            std::vector<uint64_t> layerHashes;
+            std::vector<rapidxml::xml_node<>*> layerNodes;
+            uint64_t objectsHash = 14695981039346656037ull;
+            for (rapidxml::xml_node<>* node = mapNode->first_node(); node; node = node->next_sibling())
+            {
+                std::string_view name(node->name(), node->name_size());
+                if (name == "layer")
+                {
+                    layerNodes.push_back(node);
+                    layerHashes.push_back(HashNode(node));
+                }
+                else if (name == "objectgroup")
+                {
+                    objectsHash = HashNode(node, objectsHash);
+                }
+            }
+
+            rapidxml::xml_node<>* mapProperties = mapNode->first_node("properties");
+            uint64_t mapPropertiesHash = mapProperties ? HashNode(mapProperties) : 0;
+
+            if (!initialise)
+            {
+                patch.replaceLayers = layerHashes.size() != mLayerHashes.size();
+                for (size_t i = 0; i < layerNodes.size(); i++)
+                {
+                    if (!patch.replaceLayers && layerHashes[i] == mLayerHashes[i]) continue;
+
+                    Layer layer(0, 0);
+                    Loader::GetLayer(layerNodes[i], layer, patch.parsed.properties);
+                    patch.layers.emplace_back(i, std::move(layer));
+                }
+
+                if (objectsHash != mObjectsHash)
+                {
+                    patch.objectsChanged = true;
+                    Loader::GetObjects(mapNode, patch.parsed);
+                }
+
+                if (mapPropertiesHash != mMapPropertiesHash)
+                {
+                    patch.mapPropertiesChanged = true;
+                    patch.parsed.mapProperties = Loader::GetProperties(mapNode, patch.parsed.properties);
+                }
+            }
+
+            mLayerHashes = std::move(layerHashes);
+            mObjectsHash = objectsHash;
+            mMapPropertiesHash = mapPropertiesHash;
+            return patch;
+        }
+
+        static void ApplyTileset(Level& level, TilesetPatch& patch, SDL_Renderer* renderer, TextureResidency* residency)
+        {
+            auto tileset = std::find_if(level.tilesets.begin(), level.tilesets.end(), [&patch](const TilesetData& set) { return set.firstID == patch.firstID; });
+            if (tileset == level.tilesets.end())
+            {
+                SDL_FreeSurface(patch.surface);
+                return;
+            }
+
+            if (!patch.imageOnly)
+            {
+                //Colliders of this tileset are the gids from its firstID up to the next tileset's
+                auto next = std::next(tileset);
+                int lastID = next != level.tilesets.end() ? next->firstID : std::numeric_limits<int>::max();
+                level.tilesetColliders.erase(level.tilesetColliders.lower_bound(patch.firstID), level.tilesetColliders.lower_bound(lastID));
+                for (auto& colliders : patch.colliders)
+                    level.tilesetColliders.insert_or_assign(colliders.first, std::move(colliders.second));
+
+                tileset->tileWidth = patch.data.tileWidth;
+                tileset->tileHeight = patch.data.tileHeight;
+                tileset->tilesetWidth = patch.data.tilesetWidth;
+                tileset->imagePath = patch.data.imagePath;
+            }
+
+            //The residency owns the textures of adopted tilesets, and also needs to know of a changed imagePath
+            if (tileset->textureSlot >= 0)
+            {
+                if (residency) residency->Replace(*tileset, patch.surface);
+                else
+                {
+                    std::cout << "Tileset " << patch.firstID << " is adopted by a TextureResidency, its texture can only be reloaded through it." << std::endl;
+                    SDL_FreeSurface(patch.surface);
+                }
+                patch.surface = nullptr;
+            }
+            else if (patch.surface)
+            {
+                if (SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, patch.surface))
+                {
+                    SDL_DestroyTexture(tileset->tilesetTex);
+                    tileset->tilesetTex = texture;
+                }
+                else
+                {
+                    std::cout << SDL_GetError() << std::endl;
+                }
+                SDL_FreeSurface(patch.surface);
+                patch.surface = nullptr;
+            }
+        }
+
+    private:
+        std::filesystem::path mMapPath;
+        std::vector<TrackedTileset> mTilesets;
+        Loader mLoader;     // Parses edits without a renderer, textures are created in ApplyPending
+
+        std::vector<uint64_t> mLayerHashes;
+        uint64_t mObjectsHash = 0;
+        uint64_t mMapPropertiesHash = 0;
+
+        std::vector<Patch> mPending;
+        mutable std::mutex mMutex;
+
+        std::atomic<bool> mStopping{ false };
+        std::thread mThread;
+    };
+
+
+    // Returns a pointer to the tileset that the tileID belongs to. Returns nullptr if no match found.
+    static const TilesetData* FindTilesetData(int tileID, const std::vector<TilesetData>& tilesets)
+    {
+        auto it = std::find_if(tilesets.rbegin(), tilesets.rend(), [tileID](const auto& set) {
+            return set.firstID <= tileID;
+            });
+        if (it != tilesets.rend())
+            return &(*it);
+
+        return nullptr;
+    }
+
+    static SDL_Rect GetSrcRect(int tileID, const TilesetData* tileset)
+    {
+        if (!tileset) return {};
+
+        int index = tileID - tileset->firstID;
+        int row = index / tileset->tilesetWidth;
+        int column = index % tileset->tilesetWidth;
+        int x = column * tileset->tileWidth;
+        int y = row * tileset->tileHeight;
+
+        return { x, y, tileset->tileWidth, tileset->tileHeight };
+    }
+
+    static SDL_Rect GetSrcRect(int tileID, const std::vector<TilesetData>& tilesets)
+    {
+        return GetSrcRect(tileID, FindTilesetData(tileID, tilesets));
+    }
+
+
+    /// 
+    ///  HEADLESS MAP RASTERIZER
+    /// 
+
+    struct RasterOptions
+    {
+        int downscale = 1;          // Each output pixel is the average of a downscale x downscale block of map pixels
+        size_t threadCount = 0;     // 0 for one per core
+    };
+
+    // Composites src over dst for count pixels of premultiplied ARGB
+    inline void BlendSpan(uint32_t* dst, const uint32_t* src, size_t count)
+    {
+        size_t i = 0;
+#ifdef TMXTOSDL_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i opaque = _mm_set1_epi32(255);
+        const __m128i half = _mm_set1_epi16(128);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i alpha = _mm_srli_epi32(source, 24);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) == 0xFFFF) continue;
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, opaque)) == 0xFFFF)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), source);
+                continue;
+            }
+
+            //Spread 255 - alpha of each pixel over its four 16 bit channels
+            __m128i inverse = _mm_sub_epi32(opaque, alpha);
+            inverse = _mm_packs_epi32(inverse, inverse);
+            inverse = _mm_unpacklo_epi16(inverse, inverse);
+            __m128i inverseLow = _mm_unpacklo_epi32(inverse, inverse);
+            __m128i inverseHigh = _mm_unpackhi_epi32(inverse, inverse);
+
+            __m128i dest = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+            __m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(dest, zero), inverseLow), half);
+            __m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(dest, zero), inverseHigh), half);
+
+            //x / 255 as (x + 128 + ((x + 128) >> 8)) >> 8
+            low = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+            high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_adds_epu8(source, _mm_packus_epi16(low, high)));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            uint32_t source = src[i];
+            uint32_t inverse = 255 - (source >> 24);
+            if (inverse == 255) continue;
+            if (inverse == 0) { dst[i] = source; continue; }
+
+            uint32_t dest = dst[i];
+            uint32_t result = 0;
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                uint32_t scaled = (((dest >> shift) & 0xFF) * inverse) + 128;
+                uint32_t channel = ((source >> shift) & 0xFF) + ((scaled + (scaled >> 8)) >> 8);
+                result |= std::min<uint32_t>(channel, 255) << shift;
+            }
+            dst[i] = result;
+        }
+    }
+
+    // A tileset's image decoded, premultiplied and box filtered down by the raster scale. Each tile's pixels are
+    // stored together.
+    struct RasterTileset
+    {
+        int firstID = 0;
+        int tileCount = 0;
+        int width = 0;      // Scaled tile size
+        int height = 0;
+        std::vector<uint32_t> pixels;
+
+        const uint32_t* tile(int index) const { return pixels.data() + (static_cast<size_t>(index) * width * height); }
+    };
+
+    inline RasterTileset BuildRasterTileset(const TilesetData& tileset, int scale)
+    {
+        RasterTileset raster;
+        raster.firstID = tileset.firstID;
+        if (tileset.imagePath.empty() || tileset.tileWidth <= 0 || tileset.tileHeight <= 0 || tileset.tilesetWidth <= 0) return raster;
+
+        SDL_Surface* image = IMG_Load(tileset.imagePath.string().c_str());
+        if (!image) { std::cout << "Could not load textures." << std::endl; return raster; }
+        SDL_Surface* converted = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_ARGB8888, 0);
+        SDL_FreeSurface(image);
+        if (!converted) { std::cout << SDL_GetError() << std::endl; return raster; }
+
+        int rows = converted->h / tileset.tileHeight;
+        raster.tileCount = rows * tileset.tilesetWidth;
+        raster.width = std::max(1, tileset.tileWidth / scale);
+        raster.height = std::max(1, tileset.tileHeight / scale);
+        raster.pixels.resize(static_cast<size_t>(raster.tileCount) * raster.width * raster.height);
+
+        SDL_LockSurface(converted);
+        for (int tile = 0; tile < raster.tileCount; tile++)
+        {
+            int originX = (tile % tileset.tilesetWidth) * tileset.tileWidth;
+            int originY = (tile / tileset.tilesetWidth) * tileset.tileHeight;
+            uint32_t* out = raster.pixels.data() + (static_cast<size_t>(tile) * raster.width * raster.height);
+
+            for (int y = 0; y < raster.height; y++)
+            {
+                for (int x = 0; x < raster.width; x++)
+                {
+                    //Average the block in premultiplied space so transparent pixels don't bleed colour
+                    uint32_t sum[4] = {};
+                    int count = 0;
+                    for (int blockY = y * scale; blockY < std::min((y + 1) * scale, tileset.tileHeight); blockY++)
+                    {
+                        const uint32_t* row = reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(converted->pixels) + (static_cast<size_t>(originY + blockY) * converted->pitch));
+                        for (int blockX = x * scale; blockX < std::min((x + 1) * scale, tileset.tileWidth); blockX++)
+                        {
+                            uint32_t pixel = row[originX + blockX];
+                            uint32_t alpha = pixel >> 24;
+                            sum[0] += (((pixel & 0xFF) * alpha) + 127) / 255;
+                            sum[1] += ((((pixel >> 8) & 0xFF) * alpha) + 127) / 255;
+                            sum[2] += ((((pixel >> 16) & 0xFF) * alpha) + 127) / 255;
+                            sum[3] += alpha;
+                            count++;
+                        }
+                    }
+
+                    uint32_t pixel = 0;
+                    for (int channel = 0; channel < 4 && count; channel++)
+                        pixel |= ((sum[channel] + (count / 2)) / count) << (channel * 8);
+                    out[(y * raster.width) + x] = pixel;
+                }
+            }
+        }
+        SDL_UnlockSurface(converted);
+        SDL_FreeSurface(converted);
+        return raster;
+    }
+
+    // Composites every layer of the level onto a new ARGB8888 surface on the CPU, so no window or renderer is needed.
+    // Tileset images are decoded from TilesetData::imagePath. Output rows are split between threads. A downscale that
+    // divides the tile size gives exact box filtering; tiles larger than a map cell overhang upwards as in Tiled.
+    // Returns nullptr if the level has no tiles or the surface can't be created. The caller frees the surface.
+    inline SDL_Surface* RasterizeLevel(const Level& level, const RasterOptions& options = {})
+    {
+        TMXTOSDL_PROFILE_SCOPE("RasterizeLevel");
+        const int scale = std::max(1, options.downscale);
+        int cellWidth = level.tileWidth;
+        int cellHeight = level.tileHeight;
+        if ((cellWidth <= 0 || cellHeight <= 0) && !level.tilesets.empty())
+        {
+            cellWidth = level.tilesets.front().tileWidth;
+            cellHeight = level.tilesets.front().tileHeight;
+        }
+        if (cellWidth <= 0 || cellHeight <= 0) return nullptr;
+
+        //Tile bounds of all layers, infinite layers can start at negative coordinates
+        int minX = std::numeric_limits<int>::max(), minY = std::numeric_limits<int>::max();
+        int maxX = std::numeric_limits<int>::min(), maxY = std::numeric_limits<int>::min();
+        for (const Layer& layer : level.layers)
+        {
+            if (!layer.isInfinite())
+            {
+                if (!layer.getWidth() || !layer.getHeight()) continue;
+                minX = std::min(minX, 0);
+                minY = std::min(minY, 0);
+                maxX = std::max(maxX, static_cast<int>(layer.getWidth()));
+                maxY = std::max(maxY, static_cast<int>(layer.getHeight()));
+                continue;
+            }
+
+            //Decode every chunk up front, chunks decode lazily and that isn't safe across threads
+            layer.decodeAllChunks();
+            for (const std::pair<int, int>& chunk : layer.getChunkCoords())
+            {
+                minX = std::min(minX, chunk.first * layer.getChunkWidth());
+                minY = std::min(minY, chunk.second * layer.getChunkHeight());
+                maxX = std::max(maxX, (chunk.first + 1) * layer.getChunkWidth());
+                maxY = std::max(maxY, (chunk.second + 1) * layer.getChunkHeight());
+            }
+        }
+        if (minX >= maxX || minY >= maxY) return nullptr;
+
+        const int scaledCellWidth = std::max(1, cellWidth / scale);
+        const int scaledCellHeight = std::max(1, cellHeight / scale);
+        const int surfaceWidth = (maxX - minX) * scaledCellWidth;
+        const int surfaceHeight = (maxY - minY) * scaledCellHeight;
+
+        SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, surfaceWidth, surfaceHeight, 32, SDL_PIXELFORMAT_ARGB8888);
+        if (!surface) { std::cout << SDL_GetError() << std::endl; return nullptr; }
+
+        const size_t threadCount = std::max<size_t>(1, options.threadCount ? options.threadCount : std::thread::hardware_concurrency());
+        ThreadPool pool(threadCount);
+
+        std::vector<RasterTileset> tilesets(level.tilesets.size());
+        {
+            TMXTOSDL_PROFILE_SCOPE("BuildRasterTilesets");
+            std::vector<std::future<void>> pending;
+            for (size_t i = 0; i < level.tilesets.size(); i++)
+                pending.push_back(pool.Enqueue([&tilesets, &level, i, scale]() { tilesets[i] = BuildRasterTileset(level.tilesets[i], scale); }));
+            for (std::future<void>& build : pending)
+                build.get();
+        }
+
+        //Tiles taller than a cell overhang into the rows above, so a band also draws a few tile rows below it
+        int tallestTile = scaledCellHeight;
+        for (const RasterTileset& tileset : tilesets)
+            tallestTile = std::max(tallestTile, tileset.height);
+        const int overhangRows = (tallestTile + scaledCellHeight - 1) / scaledCellHeight - 1;
+
+        SDL_LockSurface(surface);
+        auto drawBand = [&](int bandStart, int bandEnd) {
+            std::vector<uint32_t> flipped;
+            int firstRow = (bandStart / scaledCellHeight) + minY;
+            int lastRow = std::min(((bandEnd - 1) / scaledCellHeight) + minY + overhangRows, maxY - 1);
+
+            for (const Layer& layer : level.layers)
+            {
+                for (int tileY = firstRow; tileY <= lastRow; tileY++)
+                {
+                    for (int tileX = minX; tileX < maxX; tileX++)
+                    {
+                        uint32_t gid = static_cast<uint32_t>(layer.getTile(tileX, tileY));
+                        int id = static_cast<int>(gid & 0x0FFFFFFF);
+                        if (!id) continue;
+
+                        auto set = std::upper_bound(tilesets.begin(), tilesets.end(), id, [](int value, const RasterTileset& tileset) { return value < tileset.firstID; });
+                        if (set == tilesets.begin()) continue;
+                        const RasterTileset& tileset = *(set - 1);
+                        int index = id - tileset.firstID;
+                        if (index >= tileset.tileCount) continue;
+
+                        //Tiles sit on the bottom left corner of their cell
+                        int left = (tileX - minX) * scaledCellWidth;
+                        int top = ((tileY - minY + 1) * scaledCellHeight) - tileset.height;
+                        int rowStart = std::max(top, bandStart);
+                        int rowEnd = std::min(top + tileset.height, bandEnd);
+                        int width = std::min(tileset.width, surfaceWidth - left);
+                        if (rowStart >= rowEnd || width <= 0) continue;
+
+                        bool flipH = gid & 0x80000000u;
+                        bool flipV = gid & 0x40000000u;
+                        bool flipD = (gid & 0x20000000u) && tileset.width == tileset.height;
+                        const uint32_t* pixels = tileset.tile(index);
+                        for (int y = rowStart; y < rowEnd; y++)
+                        {
+                            uint32_t* dst = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(surface->pixels) + (static_cast<size_t>(y) * surface->pitch)) + left;
+                            int sourceY = y - top;
+                            if (!flipH && !flipV && !flipD)
+                            {
+                                BlendSpan(dst, pixels + (static_cast<size_t>(sourceY) * tileset.width), width);
+                                continue;
+                            }
+
+                            //Undo the flips in reverse order: vertical, horizontal, then the diagonal
+                            flipped.resize(width);
+                            int v = flipV ? tileset.height - 1 - sourceY : sourceY;
+                            for (int x = 0; x < width; x++)
+                            {
+                                int u = flipH ? tileset.width - 1 - x : x;
+                                flipped[x] = flipD ? pixels[(u * tileset.width) + v] : pixels[(v * tileset.width) + u];
+                            }
+                            BlendSpan(dst, flipped.data(), width);
+                        }
+                    }
+                }
+            }
+
+            //Back to straight alpha
+            for (int y = bandStart; y < bandEnd; y++)
+            {
+                uint32_t* row = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(surface->pixels) + (static_cast<size_t>(y) * surface->pitch));
+                for (int x = 0; x < surfaceWidth; x++)
+                {
+                    uint32_t pixel = row[x];
+                    uint32_t alpha = pixel >> 24;
+                    if (alpha == 0 || alpha == 255) continue;
+
+                    uint32_t result = alpha << 24;
+                    for (int shift = 0; shift < 24; shift += 8)
+                        result |= std::min<uint32_t>(((((pixel >> shift) & 0xFF) * 255) + (alpha / 2)) / alpha, 255) << shift;
+                    row[x] = result;
+                }
+            }
+        };
+
+        {
+            TMXTOSDL_PROFILE_SCOPE("CompositeLayers");
+            //A few bands per thread keeps threads busy when some parts of the map are denser than others
+            int bandCount = static_cast<int>(std::min<size_t>(threadCount * 4, static_cast<size_t>(surfaceHeight)));
+            std::vector<std::future<void>> pending;
+            for (int band = 0; band < bandCount; band++)
+            {
+                int bandStart = static_cast<int>((static_cast<int64_t>(surfaceHeight) * band) / bandCount);
+                int bandEnd = static_cast<int>((static_cast<int64_t>(surfaceHeight) * (band + 1)) / bandCount);
+                pending.push_back(pool.Enqueue([&drawBand, bandStart, bandEnd]() { drawBand(bandStart, bandEnd); }));
+            }
+            for (std::future<void>& band : pending)
+                band.get();
+        }
+        SDL_UnlockSurface(surface);
+        return surface;
+    }
+
+
+    /// 
+    ///  GRID PATHFINDING
+    /// 
+
+    // Index of the lowest and highest set bit of a non-zero word
+    inline int LowestSetBit(uint64_t word)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, word);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctzll(word);
+#endif
+    }
+
+    inline int HighestSetBit(uint64_t word)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, word);
+        return static_cast<int>(index);
+#else
+        return 63 - __builtin_clzll(word);
+#endif
+    }
+
+    // Cost of entering each tile, laid out like a WalkabilityGrid. Costs must be greater than 0.
+    class MovementCosts
+    {
+    public:
+        MovementCosts() = default;
+        MovementCosts(int originX, int originY, int width, int height, float cost = 1.0f)
+            : mOriginX(originX), mOriginY(originY), mWidth(std::max(width, 0)), mHeight(std::max(height, 0)),
+            mMinCost(cost), mCosts(static_cast<size_t>(mWidth) * mHeight, cost) {}
+
+        float GetCost(int x, int y) const
+        {
+            if (x < mOriginX || y < mOriginY || x - mOriginX >= mWidth || y - mOriginY >= mHeight) return mMinCost;
+            return mCosts[(static_cast<size_t>(y - mOriginY) * mWidth) + (x - mOriginX)];
+        }
+
+        void SetCost(int x, int y, float cost)
+        {
+            if (x < mOriginX || y < mOriginY || x - mOriginX >= mWidth || y - mOriginY >= mHeight) return;
+            mCosts[(static_cast<size_t>(y - mOriginY) * mWidth) + (x - mOriginX)] = cost;
+            mMinCost = std::min(mMinCost, cost);
+        }
+
+        // Lowest cost ever set, which keeps the A* heuristic admissible
+        float GetMinCost() const { return mMinCost; }
+
+    private:
+        int mOriginX = 0;
+        int mOriginY = 0;
+        int mWidth = 0;
+        int mHeight = 0;
+        float mMinCost = 1.0f;
+        std::vector<float> mCosts;
+    };
+
+    // Costs for every cell of grid. Each tile costs the value of the GID on the topmost of the chosen layers (all
+    // layers if empty) that is listed in gidCosts, or defaultCost if none are.
+    inline MovementCosts BuildMovementCosts(const Level& level, const WalkabilityGrid& grid, const std::unordered_map<int, float>& gidCosts,
+        const std::vector<size_t>& layers = {}, float defaultCost = 1.0f)
+    {
+        MovementCosts costs(grid.GetOriginX(), grid.GetOriginY(), grid.GetWidth(), grid.GetHeight(), defaultCost);
+
+        std::vector<const Layer*> chosen;
+        for (size_t i = 0; i < level.layers.size(); i++)
+        {
+            if (layers.empty() || std::find(layers.begin(), layers.end(), i) != layers.end()) chosen.push_back(&level.layers[i]);
+        }
+        std::reverse(chosen.begin(), chosen.end());
+
+        for (int y = grid.GetOriginY(); y < grid.GetOriginY() + grid.GetHeight(); y++)
+        {
+            for (int x = grid.GetOriginX(); x < grid.GetOriginX() + grid.GetWidth(); x++)
+            {
+                for (const Layer* layer : chosen)
+                {
+                    auto it = gidCosts.find(layer->getTile(x, y) & 0x0FFFFFFF);
+                    if (it == gidCosts.end()) continue;
+
+                    costs.SetCost(x, y, it->second);
+                    break;
+                }
+            }
+        }
+        return costs;
+    }
+
+    // Finds 8-way paths on a WalkabilityGrid. Diagonal moves may not cut the corner of a solid tile. Straight moves
+    // cost 1 and diagonal moves sqrt(2), times the cost of the tile entered when MovementCosts are given.
+    // Search state is allocated once per grid size and reused, so a query allocates nothing but its path. One
+    // Pathfinder must only be used by one thread at a time; the grid and costs must outlive it.
+    class Pathfinder
+    {
+    public:
+        explicit Pathfinder(const WalkabilityGrid& grid, const MovementCosts* costs = nullptr)
+            : mGrid(&grid), mCosts(costs)
+        {
+            Begin();
+        }
+
+        // Fills path with every tile from start to goal, both included. Uses jump point search when there are no
+        // movement costs and A* otherwise. Returns false if the goal can't be reached.
+        bool FindPath(SDL_Point start, SDL_Point goal, std::vector<SDL_Point>& path, float* cost = nullptr)
+        {
+            return mCosts ? FindPathAStar(start, goal, path, cost) : FindPathJPS(start, goal, path, cost);
+        }
+
+        bool FindPathAStar(SDL_Point start, SDL_Point goal, std::vector<SDL_Point>& path, float* cost = nullptr)
+        {
+            TMXTOSDL_PROFILE_SCOPE("Pathfinder::FindPathAStar");
+            path.clear();
+            if (!mGrid->IsWalkable(start.x, start.y) || !mGrid->IsWalkable(goal.x, goal.y)) return false;
+
+            Begin();
+            const float minCost = mCosts ? mCosts->GetMinCost() : 1.0f;
+            Open(Index(start.x, start.y), NoParent, 0.0f, Distance(start, goal) * minCost);
+
+            while (!mOpen.empty())
+            {
+                std::pop_heap(mOpen.begin(), mOpen.end(), std::greater<OpenNode>());
+                uint32_t cell = mOpen.back().cell;
+                mOpen.pop_back();
+                if (mNodes[cell].closed == mGeneration) continue;
+
+                mNodes[cell].closed = mGeneration;
+                SDL_Point point = Point(cell);
+                if (point.x == goal.x && point.y == goal.y) return BuildPath(cell, path, cost);
+                mExpanded++;
+
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        if (!dx && !dy) continue;
+
+                        SDL_Point next = { point.x + dx, point.y + dy };
+                        if (!mGrid->IsWalkable(next.x, next.y)) continue;
+                        if (dx && dy && (!mGrid->IsWalkable(point.x + dx, point.y) || !mGrid->IsWalkable(point.x, point.y + dy))) continue;
+
+                        float step = (dx && dy) ? Sqrt2 : 1.0f;
+                        if (mCosts) step *= mCosts->GetCost(next.x, next.y);
+                        Open(Index(next.x, next.y), cell, mNodes[cell].g + step, Distance(next, goal) * minCost);
+                    }
+                }
+            }
+            return false;
+        }
+
+        bool FindPathJPS(SDL_Point start, SDL_Point goal, std::vector<SDL_Point>& path, float* cost = nullptr)
+        {
+            TMXTOSDL_PROFILE_SCOPE("Pathfinder::FindPathJPS");
+            path.clear();
+            if (!mGrid->IsWalkable(start.x, start.y) || !mGrid->IsWalkable(goal.x, goal.y)) return false;
+
+            Begin();
+            Open(Index(start.x, start.y), NoParent, 0.0f, Distance(start, goal));
+
+            std::array<SDL_Point, 8> directions;
+            while (!mOpen.empty())
+            {
+                std::pop_heap(mOpen.begin(), mOpen.end(), std::greater<OpenNode>());
+                uint32_t cell = mOpen.back().cell;
+                mOpen.pop_back();
+                if (mNodes[cell].closed == mGeneration) continue;
+
+                mNodes[cell].closed = mGeneration;
+                SDL_Point point = Point(cell);
+                if (point.x == goal.x && point.y == goal.y) return BuildPath(cell, path, cost);
+                mExpanded++;
+
+                size_t count = PrunedDirections(cell, point, directions);
+                for (size_t i = 0; i < count; i++)
+                {
+                    SDL_Point jump;
+                    if (!Jump(point.x + directions[i].x, point.y + directions[i].y, directions[i].x, directions[i].y, goal, jump)) continue;
+
+                    Open(Index(jump.x, jump.y), cell, mNodes[cell].g + Distance(point, jump), Distance(jump, goal));
+                }
+            }
+            return false;
+        }
+
+        // Tiles expanded by the last query
+        size_t GetExpandedCount() const { return mExpanded; }
+
+        size_t GetMemoryUsage() const { return sizeof(Pathfinder) + VectorBytes(mNodes) + VectorBytes(mOpen); }
+
+    private:
+        static constexpr float Sqrt2 = 1.41421356f;
+        static constexpr uint32_t NoParent = std::numeric_limits<uint32_t>::max();
+
+        struct Node
+        {
+            float g;
+            uint32_t parent;
+            uint32_t seen;      // Generation of the query that last reached this tile
+            uint32_t closed;    // Generation of the query that last expanded this tile
+        };
+
+        struct OpenNode
+        {
+            float f;
+            uint32_t cell;
+            bool operator>(const OpenNode& other) const { return f > other.f; }
+        };
+
+        // Starts a query. Nodes are stamped with a generation instead of being cleared.
+        void Begin()
+        {
+            mExpanded = 0;
+            mOpen.clear();
+
+            size_t cells = static_cast<size_t>(mGrid->GetWidth()) * mGrid->GetHeight();
+            if (mNodes.size() != cells)
+            {
+                mNodes.assign(cells, Node{ 0.0f, NoParent, 0, 0 });
+                mOpen.reserve(std::min<size_t>(cells, 4096));
+                mGeneration = 0;
+            }
+
+            if (++mGeneration == 0)
+            {
+                for (Node& node : mNodes)
+                    node.seen = node.closed = 0;
+                mGeneration = 1;
+            }
+        }
+
+        void Open(uint32_t cell, uint32_t parent, float g, float h)
+        {
+            Node& node = mNodes[cell];
+            if (node.closed == mGeneration) return;
+            if (node.seen == mGeneration && node.g <= g) return;
+
+            node.g = g;
+            node.parent = parent;
+            node.seen = mGeneration;
+            mOpen.push_back({ g + h, cell });
+            std::push_heap(mOpen.begin(), mOpen.end(), std::greater<OpenNode>());
+        }
+
+        uint32_t Index(int x, int y) const
+        {
+            return static_cast<uint32_t>((static_cast<size_t>(y - mGrid->GetOriginY()) * mGrid->GetWidth()) + (x - mGrid->GetOriginX()));
+        }
+
+        SDL_Point Point(uint32_t cell) const
+        {
+            int width = mGrid->GetWidth();
+            return { mGrid->GetOriginX() + static_cast<int>(cell % width), mGrid->GetOriginY() + static_cast<int>(cell / width) };
+        }
+
+        // Octile distance
+        static float Distance(SDL_Point a, SDL_Point b)
+        {
+            int dx = std::abs(a.x - b.x), dy = std::abs(a.y - b.y);
+            return static_cast<float>(std::max(dx, dy) - std::min(dx, dy)) + (Sqrt2 * std::min(dx, dy));
+        }
+
+        // Walks back from the goal and fills in the tiles between jump points
+        bool BuildPath(uint32_t goal, std::vector<SDL_Point>& path, float* cost) const
+        {
+            if (cost) *cost = mNodes[goal].g;
+
+            for (uint32_t cell = goal; cell != NoParent; cell = mNodes[cell].parent)
+            {
+                SDL_Point point = Point(cell);
+                if (!path.empty())
+                {
+                    SDL_Point last = path.back();
+                    int dx = (point.x > last.x) - (point.x < last.x), dy = (point.y > last.y) - (point.y < last.y);
+                    for (SDL_Point step = { last.x + dx, last.y + dy }; step.x != point.x || step.y != point.y; step.x += dx, step.y += dy)
+                        path.push_back(step);
+                }
+                path.push_back(point);
+            }
+            std::reverse(path.begin(), path.end());
+            return true;
+        }
+
+        // Directions worth searching from a tile, given the direction it was reached from
+        size_t PrunedDirections(uint32_t cell, SDL_Point point, std::array<SDL_Point, 8>& directions) const
+        {
+            auto open = [this, point](int dx, int dy) { return mGrid->IsWalkable(point.x + dx, point.y + dy); };
+            size_t count = 0;
+
+            uint32_t parent = mNodes[cell].parent;
+            if (parent == NoParent)
+            {
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        if ((dx || dy) && (!dx || !dy || (open(dx, 0) && open(0, dy)))) directions[count++] = { dx, dy };
+                    }
+                }
+                return count;
+            }
+
+            SDL_Point from = Point(parent);
+            int dx = (point.x > from.x) - (point.x < from.x), dy = (point.y > from.y) - (point.y < from.y);
+            if (dx && dy)
+            {
+                bool vertical = open(0, dy), horizontal = open(dx, 0);
+                if (vertical) directions[count++] = { 0, dy };
+                if (horizontal) directions[count++] = { dx, 0 };
+                if (vertical && horizontal) directions[count++] = { dx, dy };
+            }
+            else if (dx)
+            {
+                bool next = open(dx, 0), below = open(0, 1), above = open(0, -1);
+                if (next) directions[count++] = { dx, 0 };
+                if (next && below) directions[count++] = { dx, 1 };
+                if (next && above) directions[count++] = { dx, -1 };
+                if (below) directions[count++] = { 0, 1 };
+                if (above) directions[count++] = { 0, -1 };
+            }
+            else
+            {
+                bool next = open(0, dy), right = open(1, 0), left = open(-1, 0);
+                if (next) directions[count++] = { 0, dy };
+                if (next && right) directions[count++] = { 1, dy };
+                if (next && left) directions[count++] = { -1, dy };
+                if (right) directions[count++] = { 1, 0 };
+                if (left) directions[count++] = { -1, 0 };
+            }
+            return count;
+        }
+
+        // Moves from (x, y) in direction (dx, dy) until it reaches the goal or a tile with a forced neighbour
+        bool Jump(int x, int y, int dx, int dy, SDL_Point goal, SDL_Point& out) const
+        {
+            if (!dx || !dy) return dx ? JumpHorizontal(x, y, dx, goal, out) : JumpVertical(x, y, dy, goal, out);
+
+            SDL_Point unused;
+            while (mGrid->IsWalkable(x, y))
+            {
+                if ((x == goal.x && y == goal.y) || JumpHorizontal(x + dx, y, dx, goal, unused) || JumpVertical(x, y + dy, dy, goal, unused))
+                {
+                    out = { x, y };
+                    return true;
+                }
+                if (!mGrid->IsWalkable(x + dx, y) || !mGrid->IsWalkable(x, y + dy)) return false;
+
+                x += dx;
+                y += dy;
+            }
+            return false;
+        }
+
+        // Scans 64 tiles of the row at a time. A tile has a forced neighbour when the tile above or below it is
+        // open but the one behind that is solid.
+        bool JumpHorizontal(int x, int y, int dx, SDL_Point goal, SDL_Point& out) const
+        {
+            while (true)
+            {
+                int base = dx > 0 ? x : x - 63;
+                uint64_t solid = mGrid->GetWord(base, y);
+                uint64_t forced = (~mGrid->GetWord(base, y - 1) & mGrid->GetWord(base - dx, y - 1))
+                    | (~mGrid->GetWord(base, y + 1) & mGrid->GetWord(base - dx, y + 1));
+
+                uint64_t stops = solid | forced;
+                if (goal.y == y && goal.x >= base && goal.x - base < 64) stops |= uint64_t(1) << (goal.x - base);
+
+                if (!stops)
+                {
+                    x += dx * 64;
+                    continue;
+                }
+
+                int bit = dx > 0 ? LowestSetBit(stops) : HighestSetBit(stops);
+                if ((solid >> bit) & 1) return false;
+
+                out = { base + bit, y };
+                return true;
+            }
+        }
+
+        bool JumpVertical(int x, int y, int dy, SDL_Point goal, SDL_Point& out) const
+        {
+            for (; mGrid->IsWalkable(x, y); y += dy)
+            {
+                if ((x == goal.x && y == goal.y)
+                    || (mGrid->IsWalkable(x - 1, y) && mGrid->IsSolid(x - 1, y - dy))
+                    || (mGrid->IsWalkable(x + 1, y) && mGrid->IsSolid(x + 1, y - dy)))
+                {
+                    out = { x, y };
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        const WalkabilityGrid* mGrid;
+        const MovementCosts* mCosts;
+        std::vector<Node> mNodes;
+        std::vector<OpenNode> mOpen;
+        uint32_t mGeneration = 0;
+        size_t mExpanded = 0;
+    };
+
+    struct PathRequest
+    {
+        SDL_Point start;
+        SDL_Point goal;
+    };
+
+    struct PathResult
+    {
+        std::vector<SDL_Point> path;
+        float cost = 0.0f;
+        bool found = false;
+    };
+
+    // Runs many agents' path queries on a pool of threads, each with its own Pathfinder
+    class BatchPathfinder
+    {
+    public:
+        BatchPathfinder(const WalkabilityGrid& grid, const MovementCosts* costs = nullptr, size_t threadCount = 0)
+            : mPool(threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency()))
+        {
+            for (size_t i = 0; i < mPool.GetThreadCount(); i++)
+                mFinders.emplace_back(grid, costs);
+        }
+
+        // Fills one result per request, in the same order. Passing the same results vector every tick reuses the
+        // capacity of its paths.
+        void FindPaths(const std::vector<PathRequest>& requests, std::vector<PathResult>& results)
+        {
+            TMXTOSDL_PROFILE_SCOPE("BatchPathfinder::FindPaths");
+            results.resize(requests.size());
+
+            //Requests are taken in small groups, so a few long searches don't hold up a whole share of the batch
+            constexpr size_t GroupSize = 16;
+            std::atomic<size_t> next = 0;
+            std::vector<std::future<void>> pending;
+            for (Pathfinder& finder : mFinders)
+            {
+                pending.push_back(mPool.Enqueue([&requests, &results, &next, &finder]() {
+                    for (size_t first = next.fetch_add(GroupSize); first < requests.size(); first = next.fetch_add(GroupSize))
+                    {
+                        for (size_t i = first; i < std::min(first + GroupSize, requests.size()); i++)
+                        {
+                            PathResult& result = results[i];
+                            result.found = finder.FindPath(requests[i].start, requests[i].goal, result.path, &result.cost);
+                            if (!result.found) result.cost = 0.0f;
+                        }
+                    }
+                }));
+            }
+            for (std::future<void>& work : pending)
+                work.get();
+        }
+
+        std::vector<PathResult> FindPaths(const std::vector<PathRequest>& requests)
+        {
+            std::vector<PathResult> results;
+            FindPaths(requests, results);
+            return results;
+        }
+
+        size_t GetThreadCount() const { return mPool.GetThreadCount(); }
+
+    private:
+        ThreadPool mPool;
+        std::vector<Pathfinder> mFinders;
+    };
+
+
+    /// 
+    ///  FLOW FIELDS
+    /// 
+
+    // Steers any number of units toward one goal. The integration field holds the cost of the cheapest path from each
+    // tile to the goal, with the same moves and costs as Pathfinder, and the direction field points each tile at its
+    // cheapest neighbour. The map is split into square chunks that are searched in parallel: each pass runs a small
+    // Dijkstra inside every chunk whose border changed, and chunks that touch, diagonals included, never run at once.
+    // The grid and costs must outlive the field.
+    class FlowField
+    {
+    public:
+        FlowField(const WalkabilityGrid& grid, const MovementCosts* costs = nullptr, size_t threadCount = 0, int chunkSize = 32)
+            : mGrid(&grid), mCosts(costs), mPathfinder(grid, costs), mChunkSize(std::max(chunkSize, 4)),
+            mPool(threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency())) {}
+
+        // Points the field at goal. If the goal has moved no more than the incremental radius since the last call, the
+        // previous field is raised by the cost between the two goals, which bounds every tile from above, and only the
+        // tiles that are now closer are searched again. Directions are only recomputed in the chunks that changed.
+        void SetGoal(SDL_Point goal)
+        {
+            TMXTOSDL_PROFILE_SCOPE("FlowField::SetGoal");
+            size_t cells = static_cast<size_t>(mGrid->GetWidth()) * mGrid->GetHeight();
+            bool moved = mValid && mCost.size() == cells && (goal.x != mGoal.x || goal.y != mGoal.y)
+                && std::max(std::abs(goal.x - mGoal.x), std::abs(goal.y - mGoal.y)) <= mIncrementalRadius;
+
+            float shift = 0.0f;
+            if (moved && !mPathfinder.FindPathAStar(mGoal, goal, mPath, &shift)) moved = false;
+
+            SDL_Point previous = mGoal;
+            mGoal = goal;
+            if (!moved)
+            {
+                Recompute();
+                return;
+            }
+
+            mLastIncremental = true;
+            ForEachRowBand([this, shift](int rowStart, int rowEnd) {
+                for (size_t i = static_cast<size_t>(rowStart) * mGrid->GetWidth(); i < static_cast<size_t>(rowEnd) * mGrid->GetWidth(); i++)
+                    mCost[i] += shift;
+            });
+
+            std::vector<uint8_t> changed(mChunkCount, 0);
+            changed[ChunkOf(previous.x - mGrid->GetOriginX(), previous.y - mGrid->GetOriginY())] = 1;
+            Propagate(changed);
+            UpdateDirections(changed);
+        }
+
+        // Rebuilds the whole field, for example after the grid or costs were edited
+        void Recompute()
+        {
+            TMXTOSDL_PROFILE_SCOPE("FlowField::Recompute");
+            mLastIncremental = false;
+            mChunksX = (mGrid->GetWidth() + mChunkSize - 1) / mChunkSize;
+            mChunksY = (mGrid->GetHeight() + mChunkSize - 1) / mChunkSize;
+            mChunkCount = static_cast<size_t>(mChunksX) * mChunksY;
+
+            size_t cells = static_cast<size_t>(mGrid->GetWidth()) * mGrid->GetHeight();
+            mCost.assign(cells, Unreachable);
+            mDirection.assign(cells, NoDirection);
+            mValid = mGrid->IsWalkable(mGoal.x, mGoal.y);
+            if (!mValid) return;
+
+            std::vector<uint8_t> changed(mChunkCount, 0);
+            Propagate(changed);
+            std::fill(changed.begin(), changed.end(), 1);
+            UpdateDirections(changed);
+        }
+
+        SDL_Point GetGoal() const { return mGoal; }
+
+        // Cost of the cheapest path from (x, y) to the goal, infinite if there is none
+        float GetCost(int x, int y) const
+        {
+            if (!mValid || !mGrid->Contains(x, y)) return Unreachable;
+            return mCost[Index(x - mGrid->GetOriginX(), y - mGrid->GetOriginY())];
+        }
+
+        // Step to take from (x, y), each component -1, 0 or 1. Zero at the goal and where the goal can't be reached.
+        SDL_Point GetDirection(int x, int y) const
+        {
+            if (!mValid || !mGrid->Contains(x, y)) return { 0, 0 };
+
+            uint8_t direction = mDirection[Index(x - mGrid->GetOriginX(), y - mGrid->GetOriginY())];
+            if (direction == NoDirection) return { 0, 0 };
+            return { Offsets[direction].x, Offsets[direction].y };
+        }
+
+        void SetIncrementalRadius(int radius) { mIncrementalRadius = radius; }
+        int GetIncrementalRadius() const { return mIncrementalRadius; }
+
+        // Whether the last SetGoal reused the previous field, and how many chunk searches it ran
+        bool WasIncremental() const { return mLastIncremental; }
+        size_t GetChunkPasses() const { return mChunkPasses; }
+
+        size_t GetMemoryUsage() const { return sizeof(FlowField) + VectorBytes(mCost) + VectorBytes(mDirection) + mPathfinder.GetMemoryUsage(); }
+
+    private:
+        static constexpr float Unreachable = std::numeric_limits<float>::infinity();
+        static constexpr float Sqrt2 = 1.41421356f;
+        static constexpr uint8_t NoDirection = 8;
+        static constexpr SDL_Point Offsets[8] = { { -1, -1 }, { 0, -1 }, { 1, -1 }, { -1, 0 }, { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+
+        struct OpenCell
+        {
+            float cost;
+            uint32_t cell;
+            bool operator>(const OpenCell& other) const { return cost > other.cost; }
+        };
+
+        size_t Index(int x, int y) const { return (static_cast<size_t>(y) * mGrid->GetWidth()) + x; }
+        size_t ChunkOf(int x, int y) const { return (static_cast<size_t>(y / mChunkSize) * mChunksX) + (x / mChunkSize); }
+
+        // Walkability in grid-local coordinates
+        bool Open(int x, int y) const { return mGrid->IsWalkable(x + mGrid->GetOriginX(), y + mGrid->GetOriginY()); }
+
+        // Cost of stepping from a tile onto its neighbour (x + offset.x, y + offset.y), infinite if the move isn't allowed
+        float StepCost(int x, int y, SDL_Point offset) const
+        {
+            int nx = x + offset.x, ny = y + offset.y;
+            if (!Open(nx, ny)) return Unreachable;
+            if (offset.x && offset.y && (!Open(nx, y) || !Open(x, ny))) return Unreachable;
+
+            float step = (offset.x && offset.y) ? Sqrt2 : 1.0f;
+            return mCosts ? step * mCosts->GetCost(nx + mGrid->GetOriginX(), ny + mGrid->GetOriginY()) : step;
+        }
+
+        template<typename Function>
+        void ForEachRowBand(Function&& function)
+        {
+            const int height = mGrid->GetHeight();
+            const size_t bands = std::min<size_t>(mPool.GetThreadCount(), std::max(height, 1));
+            std::vector<std::future<void>> pending;
+            for (size_t band = 0; band < bands; band++)
+            {
+                int rowStart = static_cast<int>((static_cast<int64_t>(height) * band) / bands);
+                int rowEnd = static_cast<int>((static_cast<int64_t>(height) * (band + 1)) / bands);
+                pending.push_back(mPool.Enqueue([&function, rowStart, rowEnd]() { function(rowStart, rowEnd); }));
+            }
+            for (std::future<void>& work : pending)
+                work.get();
+        }
+
+        // Lowers tiles from the goal outwards until no chunk border changes. Every chunk searched is flagged in changed.
+        void Propagate(std::vector<uint8_t>& changed)
+        {
+            const int goalX = mGoal.x - mGrid->GetOriginX(), goalY = mGoal.y - mGrid->GetOriginY();
+            const size_t goalChunk = ChunkOf(goalX, goalY);
+            mCost[Index(goalX, goalY)] = 0.0f;
+            mChunkPasses = 0;
+
+            std::vector<uint8_t> active(mChunkCount, 0);
+            active[goalChunk] = 1;
+            bool seed = true;
+
+            std::vector<size_t> batch;
+            std::vector<std::future<uint16_t>> pending;
+            for (bool any = true; any;)
+            {
+                any = false;
+                for (int colour = 0; colour < 4; colour++)
+                {
+                    batch.clear();
+                    for (size_t chunk = 0; chunk < mChunkCount; chunk++)
+                    {
+                        int chunkX = static_cast<int>(chunk % mChunksX), chunkY = static_cast<int>(chunk / mChunksX);
+                        if (!active[chunk] || (chunkX & 1) + ((chunkY & 1) * 2) != colour) continue;
+
+                        active[chunk] = 0;
+                        changed[chunk] = 1;
+                        batch.push_back(chunk);
+                    }
+                    if (batch.empty()) continue;
+
+                    pending.clear();
+                    for (size_t chunk : batch)
+                    {
+                        bool withGoal = seed && chunk == goalChunk;
+                        pending.push_back(mPool.Enqueue([this, chunk, withGoal, goalX, goalY]() { return SearchChunk(chunk, withGoal ? Index(goalX, goalY) : SIZE_MAX); }));
+                    }
+                    seed = false;
+                    mChunkPasses += batch.size();
+
+                    //Wake the neighbours whose border tiles may now be cheaper
+                    for (size_t i = 0; i < batch.size(); i++)
+                    {
+                        uint16_t neighbours = pending[i].get();
+                        int chunkX = static_cast<int>(batch[i] % mChunksX), chunkY = static_cast<int>(batch[i] / mChunksX);
+                        for (int bit = 0; bit < 9; bit++)
+                        {
+                            if (!((neighbours >> bit) & 1)) continue;
+
+                            int x = chunkX + (bit % 3) - 1, y = chunkY + (bit / 3) - 1;
+                            if (x < 0 || y < 0 || x >= mChunksX || y >= mChunksY) continue;
+
+                            active[(static_cast<size_t>(y) * mChunksX) + x] = 1;
+                            any = true;
+                        }
+                    }
+                }
+            }
+        }
+
+        // Relaxes a chunk's border tiles from the tiles just outside it, then runs Dijkstra inside the chunk. Returns a
+        // bit per neighbouring chunk (3x3, row major) whose tiles touch a border tile that got cheaper.
+        uint16_t SearchChunk(size_t chunk, size_t seed)
+        {
+            const int x0 = static_cast<int>(chunk % mChunksX) * mChunkSize, y0 = static_cast<int>(chunk / mChunksX) * mChunkSize;
+            const int x1 = std::min(x0 + mChunkSize, mGrid->GetWidth()), y1 = std::min(y0 + mChunkSize, mGrid->GetHeight());
+            const int width = mGrid->GetWidth();
+            auto inside = [=](int x, int y) { return x >= x0 && y >= y0 && x < x1 && y < y1; };
+
+            thread_local std::vector<OpenCell> open;
+            open.clear();
+            if (seed != SIZE_MAX) open.push_back({ 0.0f, static_cast<uint32_t>(seed) });
+
+            for (int y = y0; y < y1; y++)
+            {
+                int step = (y == y0 || y == y1 - 1) ? 1 : std::max(x1 - x0 - 1, 1);
+                for (int x = x0; x < x1; x += step)
+                {
+                    if (!Open(x, y)) continue;
+
+                    float& cost = mCost[Index(x, y)];
+                    float best = cost;
+                    for (const SDL_Point& offset : Offsets)
+                    {
+                        int nx = x + offset.x, ny = y + offset.y;
+                        if (inside(nx, ny) || nx < 0 || ny < 0 || nx >= width || ny >= mGrid->GetHeight()) continue;
+
+                        float neighbour = mCost[Index(nx, ny)];
+                        if (neighbour < best) best = std::min(best, neighbour + StepCost(x, y, offset));
+                    }
+                    if (best < cost)
+                    {
+                        cost = best;
+                        open.push_back({ best, static_cast<uint32_t>(Index(x, y)) });
+                    }
+                }
+            }
+            std::make_heap(open.begin(), open.end(), std::greater<OpenCell>());
+
+            uint16_t neighbours = 0;
+            while (!open.empty())
+            {
+                std::pop_heap(open.begin(), open.end(), std::greater<OpenCell>());
+                OpenCell current = open.back();
+                open.pop_back();
+                if (current.cost > mCost[current.cell]) continue;
+
+                int x = static_cast<int>(current.cell % width), y = static_cast<int>(current.cell / width);
+                if (x == x0 || y == y0 || x == x1 - 1 || y == y1 - 1)
+                {
+                    for (const SDL_Point& offset : Offsets)
+                    {
+                        int nx = x + offset.x, ny = y + offset.y;
+                        if (!inside(nx, ny)) neighbours |= 1 << ((((ny >= y1) - (ny < y0) + 1) * 3) + ((nx >= x1) - (nx < x0) + 1));
+                    }
+                }
+
+                //Moving from a neighbour onto this tile costs this tile's cost, so it's the same for every neighbour
+                float enter = mCosts ? mCosts->GetCost(x + mGrid->GetOriginX(), y + mGrid->GetOriginY()) : 1.0f;
+                for (const SDL_Point& offset : Offsets)
+                {
+                    int nx = x + offset.x, ny = y + offset.y;
+                    if (!inside(nx, ny) || !Open(nx, ny)) continue;
+                    if (offset.x && offset.y && (!Open(nx, y) || !Open(x, ny))) continue;
+
+                    float cost = current.cost + (((offset.x && offset.y) ? Sqrt2 : 1.0f) * enter);
+                    float& neighbour = mCost[Index(nx, ny)];
+                    if (cost < neighbour)
+                    {
+                        neighbour = cost;
+                        open.push_back({ cost, static_cast<uint32_t>(Index(nx, ny)) });
+                        std::push_heap(open.begin(), open.end(), std::greater<OpenCell>());
+                    }
+                }
+            }
+            return neighbours;
+        }
+
+        // Recomputes directions in every changed chunk and the chunks around it, whose border tiles read its costs
+        void UpdateDirections(const std::vector<uint8_t>& changed)
+        {
+            std::vector<uint8_t> dirty(mChunkCount, 0);
+            for (size_t chunk = 0; chunk < mChunkCount; chunk++)
+            {
+                if (!changed[chunk]) continue;
+
+                int chunkX = static_cast<int>(chunk % mChunksX), chunkY = static_cast<int>(chunk / mChunksX);
+                for (int y = std::max(chunkY - 1, 0); y <= std::min(chunkY + 1, mChunksY - 1); y++)
+                {
+                    for (int x = std::max(chunkX - 1, 0); x <= std::min(chunkX + 1, mChunksX - 1); x++)
+                        dirty[(static_cast<size_t>(y) * mChunksX) + x] = 1;
+                }
+            }
+
+            const int goalX = mGoal.x - mGrid->GetOriginX(), goalY = mGoal.y - mGrid->GetOriginY();
+            ForEachRowBand([&](int rowStart, int rowEnd) {
+                for (int y = rowStart; y < rowEnd; y++)
+                {
+                    for (int x = 0; x < mGrid->GetWidth(); x++)
+                    {
+                        if (!dirty[ChunkOf(x, y)]) continue;
+
+                        uint8_t direction = NoDirection;
+                        if ((x != goalX || y != goalY) && mCost[Index(x, y)] != Unreachable)
+                        {
+                            float best = Unreachable;
+                            for (uint8_t i = 0; i < 8; i++)
+                            {
+                                int nx = x + Offsets[i].x, ny = y + Offsets[i].y;
+                                if (nx < 0 || ny < 0 || nx >= mGrid->GetWidth() || ny >= mGrid->GetHeight()) continue;
+
+                                float cost = mCost[Index(nx, ny)] + StepCost(x, y, Offsets[i]);
+                                if (cost < best)
+                                {
+                                    best = cost;
+                                    direction = i;
+                                }
+                            }
+                        }
+                        mDirection[Index(x, y)] = direction;
+                    }
+                }
+            });
+        }
+
+        const WalkabilityGrid* mGrid;
+        const MovementCosts* mCosts;
+        Pathfinder mPathfinder;
+        std::vector<SDL_Point> mPath;
+        int mChunkSize;
+        int mChunksX = 0;
+        int mChunksY = 0;
+        size_t mChunkCount = 0;
+        std::vector<float> mCost;
+        std::vector<uint8_t> mDirection;
+        SDL_Point mGoal = { 0, 0 };
+        bool mValid = false;
+        bool mLastIncremental = false;
+        int mIncrementalRadius = 8;
+        size_t mChunkPasses = 0;
+        ThreadPool mPool;
+    };
+
+
+    /// 
+    ///  SUMMED-AREA TABLES
+    /// 
+
+    // Counts the filled cells of any rectangle in constant time, for questions like "is this footprint empty?". Built
+    // from a layer (non-empty tiles) or a WalkabilityGrid (solid tiles). Edits are applied to the table lazily: until
+    // the next Flush they are kept in a short list that queries add on, and a flush only recomputes the part of the
+    // table below and right of the earliest edit.
+    class SummedAreaTable
+    {
+    public:
+        SummedAreaTable() = default;
+        SummedAreaTable(int originX, int originY, int width, int height)
+            : mOriginX(originX), mOriginY(originY), mWidth(std::max(width, 0)), mHeight(std::max(height, 0)),
+            mCells(static_cast<size_t>(mWidth) * mHeight, 0), mSums(static_cast<size_t>(mWidth + 1) * (mHeight + 1), 0) {}
+
+        int GetOriginX() const { return mOriginX; }
+        int GetOriginY() const { return mOriginY; }
+        int GetWidth() const { return mWidth; }
+        int GetHeight() const { return mHeight; }
+
+        bool IsFilled(int x, int y) const
+        {
+            if (x < mOriginX || y < mOriginY || x - mOriginX >= mWidth || y - mOriginY >= mHeight) return false;
+            return mCells[(static_cast<size_t>(y - mOriginY) * mWidth) + (x - mOriginX)];
+        }
+
+        void SetFilled(int x, int y, bool filled)
+        {
+            if (x < mOriginX || y < mOriginY || x - mOriginX >= mWidth || y - mOriginY >= mHeight) return;
+
+            int localX = x - mOriginX, localY = y - mOriginY;
+            uint8_t& cell = mCells[(static_cast<size_t>(localY) * mWidth) + localX];
+            if (cell == static_cast<uint8_t>(filled)) return;
+
+            cell = filled;
+            mPending.push_back({ localX, localY, filled ? 1 : -1 });
+            mDirtyX = std::min(mDirtyX, localX);
+            mDirtyY = std::min(mDirtyY, localY);
+            if (mPending.size() >= MaxPending) Flush();
+        }
+
+        // Filled cells in rect. Cells outside the table count as empty.
+        uint32_t Count(const SDL_Rect& rect) const
+        {
+            int left = std::max(rect.x - mOriginX, 0), top = std::max(rect.y - mOriginY, 0);
+            int right = std::min(rect.x + rect.w - mOriginX, mWidth), bottom = std::min(rect.y + rect.h - mOriginY, mHeight);
+            if (left >= right || top >= bottom) return 0;
+
+            const size_t stride = static_cast<size_t>(mWidth) + 1;
+            int64_t count = static_cast<int64_t>(mSums[(bottom * stride) + right]) - mSums[(top * stride) + right]
+                - mSums[(bottom * stride) + left] + mSums[(top * stride) + left];
+
+            for (const Edit& edit : mPending)
+            {
+                if (edit.x >= left && edit.x < right && edit.y >= top && edit.y < bottom) count += edit.delta;
+            }
+            return static_cast<uint32_t>(count);
+        }
+
+        bool IsEmpty(const SDL_Rect& rect) const { return Count(rect) == 0; }
+
+        // True if every cell of rect is filled, so false for any rect that leaves the table
+        bool IsFull(const SDL_Rect& rect) const { return rect.w > 0 && rect.h > 0 && Count(rect) == static_cast<uint32_t>(rect.w) * static_cast<uint32_t>(rect.h); }
+
+        // Applies the pending edits to the sums
+        void Flush()
+        {
+            if (mPending.empty()) return;
+
+            Recompute(mDirtyX, mDirtyY);
+            mPending.clear();
+            mDirtyX = std::numeric_limits<int>::max();
+            mDirtyY = std::numeric_limits<int>::max();
+        }
+
+        size_t GetPendingCount() const { return mPending.size(); }
+
+        size_t GetMemoryUsage() const { return sizeof(SummedAreaTable) + VectorBytes(mCells) + VectorBytes(mSums) + VectorBytes(mPending); }
+
+    private:
+        friend SummedAreaTable BuildSummedAreaTable(const Layer&);
+        friend SummedAreaTable BuildSummedAreaTable(const WalkabilityGrid&);
+
+        static constexpr size_t MaxPending = 64;
+
+        struct Edit
+        {
+            int x;
+            int y;
+            int delta;
+        };
+
+        // Recomputes every sum from local cell (left, top) to the bottom right corner
+        void Recompute(int left, int top)
+        {
+            const size_t stride = static_cast<size_t>(mWidth) + 1;
+            for (int y = top; y < mHeight; y++)
+            {
+                const uint8_t* cells = mCells.data() + (static_cast<size_t>(y) * mWidth);
+                uint32_t* above = mSums.data() + (y * stride);
+                uint32_t* sums = above + stride;
+
+                //Running sum of this row up to the column before left, recovered from the sums
+                uint32_t row = sums[left] - above[left];
+                for (int x = left; x < mWidth; x++)
+                {
+                    row += cells[x];
+                    sums[x + 1] = above[x + 1] + row;
+                }
+            }
+        }
+
+        int mOriginX = 0;
+        int mOriginY = 0;
+        int mWidth = 0;
+        int mHeight = 0;
+        std::vector<uint8_t> mCells;
+        std::vector<uint32_t> mSums;    // (width + 1) * (height + 1), with a zero row and column first
+        std::vector<Edit> mPending;
+        int mDirtyX = std::numeric_limits<int>::max();
+        int mDirtyY = std::numeric_limits<int>::max();
+    };
+
+    // Table of the non-empty tiles of a layer, covering all of its chunks if it is infinite
+    inline SummedAreaTable BuildSummedAreaTable(const Layer& layer)
+    {
+        TMXTOSDL_PROFILE_SCOPE("BuildSummedAreaTable");
+        SDL_Rect bounds = GetLayerBounds(layer);
+        SummedAreaTable table(bounds.x, bounds.y, bounds.w, bounds.h);
+        layer.decodeAllChunks();
+
+        for (int y = 0; y < bounds.h; y++)
+        {
+            for (int x = 0; x < bounds.w; x++)
+                table.mCells[(static_cast<size_t>(y) * bounds.w) + x] = layer.getTile(bounds.x + x, bounds.y + y) != 0;
+        }
+        table.Recompute(0, 0);
+        return table;
+    }
+
+    // Table of the solid tiles of a grid
+    inline SummedAreaTable BuildSummedAreaTable(const WalkabilityGrid& grid)
+    {
+        TMXTOSDL_PROFILE_SCOPE("BuildSummedAreaTable");
+        SummedAreaTable table(grid.GetOriginX(), grid.GetOriginY(), grid.GetWidth(), grid.GetHeight());
+
+        for (int y = 0; y < grid.GetHeight(); y++)
+        {
+            const uint64_t* words = grid.GetRow(grid.GetOriginY() + y);
+            for (int x = 0; x < grid.GetWidth(); x++)
+                table.mCells[(static_cast<size_t>(y) * grid.GetWidth()) + x] = (words[x / 64] >> (x % 64)) & 1;
+        }
+        table.Recompute(0, 0);
+        return table;
+    }
+
+
+    /// 
+    ///  DISTANCE FIELDS
+    /// 
+
+    // Exact Euclidean distance from every tile of a WalkabilityGrid to the nearest solid tile, measured between tile
+    // centres, for steering, clearance and spacing checks. Uses the linear time transform of Felzenszwalb and
+    // Huttenlocher: a pass down each column finds the nearest solid tile in that column, then a pass along each row
+    // takes the lower envelope of the parabolas those give. Columns, then rows, are split between threads. With
+    // edgesAreSolid, the tiles around the grid count as solid. The grid must outlive the field.
+    class DistanceField
+    {
+    public:
+        explicit DistanceField(const WalkabilityGrid& grid, bool edgesAreSolid = true, size_t threadCount = 0)
+            : mGrid(&grid), mEdgesAreSolid(edgesAreSolid), mPool(threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency()))
+        {
+            Recompute();
+        }
+
+        void Recompute()
+        {
+            TMXTOSDL_PROFILE_SCOPE("DistanceField::Recompute");
+            mWidth = mGrid->GetWidth();
+            mHeight = mGrid->GetHeight();
+            mColumn.assign(static_cast<size_t>(mWidth) * mHeight, 0);
+            mSquared.assign(static_cast<size_t>(mWidth) * mHeight, 0);
+
+            Split(mWidth, [this](size_t, int start, int end) {
+                for (int x = start; x < end; x++)
+                    UpdateColumn(x, nullptr);
+            });
+            Split(mHeight, [this](size_t, int start, int end) {
+                for (int y = start; y < end; y++)
+                    UpdateRow(y);
+            });
+        }
+
+        // Updates the field after tiles in region (map tile coordinates) changed in the grid. Only the columns through
+        // region are searched again, and then only the rows whose column distances changed.
+        void Refresh(const SDL_Rect& region)
+        {
+            TMXTOSDL_PROFILE_SCOPE("DistanceField::Refresh");
+            if (mGrid->GetWidth() != mWidth || mGrid->GetHeight() != mHeight)
+            {
+                Recompute();
+                return;
+            }
+
+            int left = std::max(region.x - mGrid->GetOriginX(), 0), right = std::min(region.x + region.w - mGrid->GetOriginX(), mWidth);
+            if (left >= right || region.h <= 0) return;
+
+            //Each band flags rows in its own vector, they are merged once every band has finished
+            std::vector<std::vector<uint8_t>> rows(BandCount(right - left), std::vector<uint8_t>(mHeight, 0));
+            Split(right - left, [this, left, &rows](size_t band, int start, int end) {
+                for (int x = left + start; x < left + end; x++)
+                    UpdateColumn(x, rows[band].data());
+            });
+
+            std::vector<int> changed;
+            for (int y = 0; y < mHeight; y++)
+            {
+                if (std::any_of(rows.begin(), rows.end(), [y](const std::vector<uint8_t>& band) { return band[y] != 0; })) changed.push_back(y);
+            }
+            Split(static_cast<int>(changed.size()), [this, &changed](size_t, int start, int end) {
+                for (int i = start; i < end; i++)
+                    UpdateRow(changed[i]);
+            });
+        }
+
+        // Squared distance in tiles, 0 on solid tiles. Outside the grid this is 0 with edgesAreSolid.
+        uint32_t GetSquaredDistance(int x, int y) const
+        {
+            if (!mGrid->Contains(x, y)) return mEdgesAreSolid ? 0 : Far;
+            return mSquared[(static_cast<size_t>(y - mGrid->GetOriginY()) * mWidth) + (x - mGrid->GetOriginX())];
+        }
+
+        float GetDistance(int x, int y) const
+        {
+            uint32_t squared = GetSquaredDistance(x, y);
+            return squared == Far ? std::numeric_limits<float>::infinity() : std::sqrt(static_cast<float>(squared));
+        }
+
+        // True if no solid tile centre is within radius tiles of this tile's centre
+        bool HasClearance(int x, int y, float radius) const { return static_cast<float>(GetSquaredDistance(x, y)) > radius * radius; }
+
+        size_t GetMemoryUsage() const { return sizeof(DistanceField) + VectorBytes(mColumn) + VectorBytes(mSquared); }
+
+    private:
+        // Stands in for "no solid tile", when edges aren't solid and a column or the whole grid is open
+        static constexpr uint32_t Far = std::numeric_limits<uint32_t>::max();
+
+        size_t BandCount(int count) const { return std::min<size_t>(mPool.GetThreadCount(), std::max(count / 16, 1)); }
+
+        // Calls function(band, start, end) for BandCount(count) bands of [0, count) on the pool
+        template<typename Function>
+        void Split(int count, Function&& function)
+        {
+            const size_t bands = BandCount(count);
+            if (bands <= 1)
+            {
+                function(0, 0, count);
+                return;
+            }
+
+            std::vector<std::future<void>> pending;
+            for (size_t band = 0; band < bands; band++)
+            {
+                int start = static_cast<int>((static_cast<int64_t>(count) * band) / bands);
+                int end = static_cast<int>((static_cast<int64_t>(count) * (band + 1)) / bands);
+                pending.push_back(mPool.Enqueue([&function, band, start, end]() { function(band, start, end); }));
+            }
+            for (std::future<void>& work : pending)
+                work.get();
+        }
+
+        // Distance along column x to the nearest solid tile in it. Flags the rows whose distance changed.
+        void UpdateColumn(int x, uint8_t* changedRows)
+        {
+            thread_local std::vector<uint32_t> distances;
+            distances.resize(mHeight);
+            const int gridX = mGrid->GetOriginX() + x, originY = mGrid->GetOriginY();
+
+            //Down the column, then back up keeping the smaller distance
+            uint32_t distance = mEdgesAreSolid ? 1 : Far;
+            for (int y = 0; y < mHeight; y++)
+            {
+                if (mGrid->IsSolid(gridX, originY + y)) distance = 0;
+                distances[y] = distance;
+                if (distance != Far) distance++;
+            }
+
+            distance = mEdgesAreSolid ? 1 : Far;
+            for (int y = mHeight - 1; y >= 0; y--)
+            {
+                if (distances[y] == 0) distance = 0;
+                distances[y] = std::min(distances[y], distance);
+                if (distance != Far) distance++;
+
+                uint32_t& column = mColumn[(static_cast<size_t>(y) * mWidth) + x];
+                if (changedRows && column != distances[y]) changedRows[y] = 1;
+                column = distances[y];
+            }
+        }
+
+        // Lower envelope of the parabolas (x - q)^2 + column(q)^2 along row y
+        void UpdateRow(int y)
+        {
+            thread_local std::vector<int> vertices;
+            thread_local std::vector<double> bounds;
+            vertices.resize(mWidth);
+            bounds.resize(static_cast<size_t>(mWidth) + 1);
+
+            const uint32_t* column = mColumn.data() + (static_cast<size_t>(y) * mWidth);
+            uint32_t* squared = mSquared.data() + (static_cast<size_t>(y) * mWidth);
+            auto height = [column](int q) { return (static_cast<double>(column[q]) * column[q]) + (static_cast<double>(q) * q); };
+
+            int k = -1;
+            for (int q = 0; q < mWidth; q++)
+            {
+                if (column[q] == Far) continue;
+
+                if (k < 0)
+                {
+                    k = 0;
+                    vertices[0] = q;
+                    bounds[0] = -std::numeric_limits<double>::infinity();
+                    bounds[1] = std::numeric_limits<double>::infinity();
+                    continue;
+                }
+
+                //Drop the parabolas that the new one hides, then find where it takes over
+                double s = (height(q) - height(vertices[k])) / (2.0 * (q - vertices[k]));
+                while (s <= bounds[k])
+                {
+                    k--;
+                    s = (height(q) - height(vertices[k])) / (2.0 * (q - vertices[k]));
+                }
+                k++;
+                vertices[k] = q;
+                bounds[k] = s;
+                bounds[k + 1] = std::numeric_limits<double>::infinity();
+            }
+
+            const bool open = k < 0;
+            k = 0;
+            for (int x = 0; x < mWidth; x++)
+            {
+                uint64_t best = Far;
+                if (!open)
+                {
+                    while (bounds[k + 1] < x)
+                        k++;
+                    int64_t dx = x - vertices[k];
+                    best = static_cast<uint64_t>(dx * dx) + (static_cast<uint64_t>(column[vertices[k]]) * column[vertices[k]]);
+                }
+                if (mEdgesAreSolid)
+                {
+                    uint64_t edge = static_cast<uint64_t>(std::min(x + 1, mWidth - x));
+                    best = std::min(best, edge * edge);
+                }
+                squared[x] = static_cast<uint32_t>(std::min<uint64_t>(best, Far));
+            }
+        }
+
+        const WalkabilityGrid* mGrid;
+        bool mEdgesAreSolid;
+        int mWidth = 0;
+        int mHeight = 0;
+        std::vector<uint32_t> mColumn;     // Distance to the nearest solid tile in the same column
+        std::vector<uint32_t> mSquared;
+        ThreadPool mPool;
+    };
+
+
+    /// 
+    ///  TILE CHANGE NOTIFICATION
+    /// 
+
+    // Hands the regions edited with Layer::setTile or markDirty to the structures derived from a level, such as
+    // render caches, collision indices and walkability grids. Call Dispatch once per frame; each subscriber then
+    // sees every changed region of the layers it follows exactly once.
+    class TileChangeDispatcher
+    {
+    public:
+        using Callback = std::function<void(size_t layer, const std::vector<SDL_Rect>& regions)>;
+
+        // Follows the given layers, or all of them if empty. Returns an ID for Unsubscribe. A subscriber added from a
+        // callback is first called by the next Dispatch.
+        size_t Subscribe(Callback callback, std::vector<size_t> layers = {})
+        {
+            mSubscribers.push_back(std::make_shared<Subscriber>(Subscriber{ ++mNextID, std::move(callback), std::move(layers) }));
+            return mNextID;
+        }
+
+        // Safe to call from a callback, including the subscriber's own. It isn't called again after this returns.
+        void Unsubscribe(size_t id)
+        {
+            auto it = std::find_if(mSubscribers.begin(), mSubscribers.end(), [id](const std::shared_ptr<Subscriber>& subscriber) { return subscriber->id == id; });
+            if (it == mSubscribers.end()) return;
+
+            (*it)->active = false;
+            mSubscribers.erase(it);
+        }
+
+        // Takes the dirty regions of every layer of level and passes them on. Returns the number of layers that changed.
+        size_t Dispatch(Level& level)
+        {
+            TMXTOSDL_PROFILE_SCOPE("TileChangeDispatcher::Dispatch");
+            size_t changed = 0;
+
+            //Callbacks can subscribe and unsubscribe, so they are called from a copy of the list, which also keeps a
+            //subscriber alive while its callback runs
+            std::vector<std::shared_ptr<Subscriber>> subscribers;
+            for (size_t i = 0; i < level.layers.size(); i++)
+            {
+                if (!level.layers[i].isDirty()) continue;
+
+                std::vector<SDL_Rect> regions = level.layers[i].takeDirtyRegions();
+                if (changed++ == 0) subscribers = mSubscribers;
+                for (const std::shared_ptr<Subscriber>& subscriber : subscribers)
+                {
+                    if (!subscriber->active) continue;
+                    if (subscriber->layers.empty() || std::find(subscriber->layers.begin(), subscriber->layers.end(), i) != subscriber->layers.end())
+                        subscriber->callback(i, regions);
+                }
+            }
+            return changed;
+        }
+
+    private:
+        struct Subscriber
+        {
+            size_t id;
+            Callback callback;
+            std::vector<size_t> layers;
+            bool active = true;
+        };
+
+        std::vector<std::shared_ptr<Subscriber>> mSubscribers;
+        size_t mNextID = 0;
+    };
 
-        return nullptr;
+
+    /// 
+    ///  FAST COMPRESSION
+    /// 
+
+    inline void WriteVarint(std::vector<uint8_t>& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
     }
 
-    static SDL_Rect GetSrcRect(int tileID, const std::vector<TilesetData>& tilesets)
+    // Advances it past the varint. Returns false if the input ends first or the value doesn't fit in 64 bits.
+    inline bool ReadVarint(const uint8_t*& it, const uint8_t* end, uint64_t& value)
     {
-        return GetSrcRect(tileID, FindTilesetData(tileID, tilesets));
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (it == end) return false;
+
+            uint8_t byte = *it++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
     }
 
-    static SDL_Rect GetSrcRect(int tileID, const TilesetData* tileset)
+    // Maps signed values to unsigned ones so small negative numbers stay small as varints
+    inline uint64_t ZigZag(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+    inline int64_t UnZigZag(uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+    // Appends data compressed with a small LZ77 coder in the style of LZ4: a varint of the original size, then
+    // sequences of a token (literal count, match length), the literals and a 16 bit match offset. Matches are found
+    // through a hash of the next 4 bytes, and runs of incompressible data are skipped over faster the longer they are.
+    inline void CompressLZ(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
     {
-        if (!tileset) return {};
+        constexpr int HashBits = 14;
+        constexpr size_t MinMatch = 4;
+        constexpr size_t MaxOffset = 0xFFFF;
 
-        int index = tileID - tileset->firstID;
-        int row = index / tileset->tilesetWidth;
-        int column = index % tileset->tilesetWidth;
-        int x = column * tileset->tileWidth;
-        int y = row * tileset->tileHeight;
+        WriteVarint(out, size);
+        std::vector<uint32_t> table(size_t(1) << HashBits, 0);     // Position + 1 of the last 4 bytes with each hash
+
+        auto read32 = [data](size_t at) {
+            uint32_t value;
+            std::memcpy(&value, data + at, sizeof(value));
+            return value;
+        };
+        auto writeLength = [&out](size_t length) {
+            for (; length >= 255; length -= 255)
+                out.push_back(255);
+            out.push_back(static_cast<uint8_t>(length));
+        };
+        auto emit = [&](size_t literalStart, size_t literalCount, size_t offset, size_t matchLength) {
+            size_t matchCode = matchLength ? matchLength - MinMatch : 0;
+            out.push_back(static_cast<uint8_t>((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15)));
+            if (literalCount >= 15) writeLength(literalCount - 15);
+            out.insert(out.end(), data + literalStart, data + literalStart + literalCount);
+            if (!matchLength) return;
+
+            out.push_back(static_cast<uint8_t>(offset));
+            out.push_back(static_cast<uint8_t>(offset >> 8));
+            if (matchCode >= 15) writeLength(matchCode - 15);
+        };
+
+        size_t anchor = 0;
+        size_t i = 0;
+        while (i + MinMatch <= size)
+        {
+            uint32_t sequence = read32(i);
+            uint32_t hash = (sequence * 2654435761u) >> (32 - HashBits);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(i + 1);
+
+            if (!candidate || i - (candidate - 1) > MaxOffset || read32(candidate - 1) != sequence)
+            {
+                i += 1 + ((i - anchor) >> 6);
+                continue;
+            }
+
+            size_t match = candidate - 1;
+            size_t length = MinMatch;
+            while (i + length < size && data[match + length] == data[i + length])
+                length++;
+
+            emit(anchor, i - anchor, i - match, length);
+            i += length;
+            anchor = i;
+        }
+        if (anchor < size) emit(anchor, size - anchor, 0, 0);
+    }
+
+    // Most bytes one compressed byte can expand to: a length byte of 255 extends a match by 255 bytes
+    constexpr uint64_t MaxLZExpansion = 255;
+
+    // Replaces out with the data compressed by CompressLZ. Returns false if the input is malformed or would
+    // decompress to more than maxSize bytes. The size is checked against the input before anything is allocated.
+    inline bool DecompressLZ(const uint8_t* data, size_t size, std::vector<uint8_t>& out, size_t maxSize = 256 * 1024 * 1024)
+    {
+        const uint8_t* it = data;
+        const uint8_t* end = data + size;
+        uint64_t original;
+        if (!ReadVarint(it, end, original) || original > maxSize || original > static_cast<uint64_t>(size) * MaxLZExpansion) return false;
+
+        out.resize(static_cast<size_t>(original));
+        auto readLength = [&it, end](size_t& length) {
+            for (uint8_t byte = 255; byte == 255; length += byte)
+            {
+                if (it == end) return false;
+                byte = *it++;
+            }
+            return true;
+        };
+
+        size_t written = 0;
+        while (written < original)
+        {
+            if (it == end) return false;
+            uint8_t token = *it++;
+
+            size_t literals = token >> 4;
+            if (literals == 15 && !readLength(literals)) return false;
+            if (literals > static_cast<size_t>(end - it) || literals > original - written) return false;
+            std::memcpy(out.data() + written, it, literals);
+            it += literals;
+            written += literals;
+            if (written == original) break;
+
+            if (end - it < 2) return false;
+            size_t offset = it[0] | (static_cast<size_t>(it[1]) << 8);
+            it += 2;
+            size_t length = token & 15;
+            if (length == 15 && !readLength(length)) return false;
+            length += 4;
+            if (!offset || offset > written || length > original - written) return false;
+
+            //Copied forwards a byte at a time, so a match may overlap the bytes it produces
+            uint8_t* target = out.data() + written;
+            const uint8_t* source = target - offset;
+            if (offset >= length)
+                std::memcpy(target, source, length);
+            else
+            {
+                for (size_t i = 0; i < length; i++)
+                    target[i] = source[i];
+            }
+            written += length;
+        }
+        return it == end;
+    }
+
+
+    /// 
+    ///  TILE EDIT REPLICATION
+    /// 
+
+    // Batches the tile edits of one network tick into a compact packet. Single edits are grouped into runs along rows,
+    // regions are sent whole, and the tiles of every record are run-length encoded. The packet is then compressed with
+    // CompressLZ when that makes it smaller. Records are applied in the order they were added.
+    class TileDeltaEncoder
+    {
+    public:
+        // Records one tile. A later edit of the same tile in the same tick replaces it. The tile must lie within the layer
+        // if the layer is dense, otherwise the receiver rejects the whole packet.
+        void AddTile(size_t layer, int x, int y, int gid) { mTiles.push_back({ layer, x, y, gid }); }
+
+        // Records every tile of region as it is now, for example the dirty regions of a TileChangeDispatcher
+        void AddRegion(const Level& level, size_t layer, const SDL_Rect& region)
+        {
+            if (layer >= level.layers.size()) return;
+
+            //Dense layers have no tiles outside their bounds to send, and the receiver rejects records that reach past them
+            const Layer& source = level.layers[layer];
+            SDL_Rect clipped = region;
+            if (!source.isInfinite())
+            {
+                int right = std::min(region.x + region.w, static_cast<int>(source.getWidth()));
+                int bottom = std::min(region.y + region.h, static_cast<int>(source.getHeight()));
+                clipped.x = std::max(region.x, 0);
+                clipped.y = std::max(region.y, 0);
+                clipped.w = right - clipped.x;
+                clipped.h = bottom - clipped.y;
+            }
+            if (clipped.w <= 0 || clipped.h <= 0) return;
+
+            //Wide dirty rows are split into records the receiver accepts
+            FlushTiles();
+            for (int top = clipped.y; top < clipped.y + clipped.h; top += MaxSide)
+            {
+                for (int left = clipped.x; left < clipped.x + clipped.w; left += MaxSide)
+                {
+                    Record record = { layer, { left, top, std::min(MaxSide, clipped.x + clipped.w - left), std::min(MaxSide, clipped.y + clipped.h - top) }, {} };
+                    record.tiles.reserve(static_cast<size_t>(record.region.w) * record.region.h);
+                    for (int y = top; y < top + record.region.h; y++)
+                    {
+                        for (int x = left; x < left + record.region.w; x++)
+                            record.tiles.push_back(source.getTile(x, y));
+                    }
+                    mRecords.push_back(std::move(record));
+                }
+            }
+        }
+
+        bool IsEmpty() const { return mTiles.empty() && mRecords.empty(); }
+
+        // Replaces packet with everything recorded since the last call and starts the next batch
+        void EncodeTick(uint32_t tick, std::vector<uint8_t>& packet)
+        {
+            TMXTOSDL_PROFILE_SCOPE("TileDeltaEncoder::EncodeTick");
+            FlushTiles();
+
+            mBody.clear();
+            WriteVarint(mBody, mRecords.size());
+            int previousX = 0, previousY = 0;
+            for (const Record& record : mRecords)
+            {
+                WriteVarint(mBody, record.layer);
+                WriteVarint(mBody, ZigZag(static_cast<int64_t>(record.region.x) - previousX));
+                WriteVarint(mBody, ZigZag(static_cast<int64_t>(record.region.y) - previousY));
+                WriteVarint(mBody, static_cast<uint64_t>(record.region.w));
+                WriteVarint(mBody, static_cast<uint64_t>(record.region.h));
+                previousX = record.region.x;
+                previousY = record.region.y;
+
+                for (size_t i = 0; i < record.tiles.size();)
+                {
+                    size_t run = 1;
+                    while (i + run < record.tiles.size() && record.tiles[i + run] == record.tiles[i])
+                        run++;
+
+                    WriteVarint(mBody, run);
+                    WriteVarint(mBody, static_cast<uint32_t>(record.tiles[i]));
+                    i += run;
+                }
+            }
+            mRecords.clear();
+
+            packet.clear();
+            packet.push_back('T');
+            packet.push_back('D');
+            packet.push_back(Version);
+            WriteVarint(packet, tick);
+
+            size_t header = packet.size();
+            packet.push_back(1);
+            CompressLZ(mBody.data(), mBody.size(), packet);
+            if (packet.size() - header - 1 >= mBody.size())
+            {
+                packet.resize(header);
+                packet.push_back(0);
+                packet.insert(packet.end(), mBody.begin(), mBody.end());
+            }
+        }
+
+        std::vector<uint8_t> EncodeTick(uint32_t tick)
+        {
+            std::vector<uint8_t> packet;
+            EncodeTick(tick, packet);
+            return packet;
+        }
+
+        static constexpr uint8_t Version = 1;
+
+        // Largest record side, so a bad packet can't ask for billions of tiles. Larger edits are sent as several records.
+        static constexpr int MaxSide = 1 << 12;
+
+    private:
+        struct Tile
+        {
+            size_t layer;
+            int x;
+            int y;
+            int gid;
+        };
+
+        struct Record
+        {
+            size_t layer;
+            SDL_Rect region;
+            std::vector<int> tiles;
+        };
+
+        // Turns the single edits into records of one row each, keeping the last edit of each tile
+        void FlushTiles()
+        {
+            if (mTiles.empty()) return;
+
+            std::stable_sort(mTiles.begin(), mTiles.end(), [](const Tile& a, const Tile& b) {
+                if (a.layer != b.layer) return a.layer < b.layer;
+                if (a.y != b.y) return a.y < b.y;
+                return a.x < b.x;
+            });
+
+            for (size_t i = 0; i < mTiles.size();)
+            {
+                Record record = { mTiles[i].layer, { mTiles[i].x, mTiles[i].y, 0, 1 }, {} };
+                //A run ends at a gap or at MaxSide tiles, repeated edits of its last tile still replace it
+                while (i < mTiles.size() && mTiles[i].layer == record.layer && mTiles[i].y == record.region.y
+                    && (mTiles[i].x < record.region.x + record.region.w || (mTiles[i].x == record.region.x + record.region.w && record.region.w < MaxSide)))
+                {
+                    if (mTiles[i].x == record.region.x + record.region.w)
+                    {
+                        record.tiles.push_back(mTiles[i].gid);
+                        record.region.w++;
+                    }
+                    else
+                        record.tiles.back() = mTiles[i].gid;
+                    i++;
+                }
+                mRecords.push_back(std::move(record));
+            }
+            mTiles.clear();
+        }
+
+        std::vector<Tile> mTiles;
+        std::vector<Record> mRecords;
+        std::vector<uint8_t> mBody;
+    };
+
+    // Applies packets from a TileDeltaEncoder. Tiles are written with Layer::setTile, so the edits also reach the
+    // layers' dirty regions and any TileChangeDispatcher subscribers.
+    class TileDeltaDecoder
+    {
+    public:
+        // Returns false, changing nothing, if the packet is malformed, names a layer the level doesn't have, or has a
+        // record reaching outside a dense layer
+        bool Apply(Level& level, const uint8_t* data, size_t size, uint32_t* tick = nullptr)
+        {
+            TMXTOSDL_PROFILE_SCOPE("TileDeltaDecoder::Apply");
+            const uint8_t* it = data;
+            const uint8_t* end = data + size;
+            uint64_t packetTick;
+            if (size < 4 || it[0] != 'T' || it[1] != 'D' || it[2] != TileDeltaEncoder::Version) return false;
+            it += 3;
+            if (!ReadVarint(it, end, packetTick) || it == end) return false;
+
+            uint8_t compressed = *it++;
+            if (compressed > 1) return false;
+            if (compressed)
+            {
+                if (!DecompressLZ(it, static_cast<size_t>(end - it), mBody)) return false;
+            }
+            else
+                mBody.assign(it, end);
+
+            //Everything is checked before the first tile is written
+            it = mBody.data();
+            end = mBody.data() + mBody.size();
+            uint64_t recordCount;
+            if (!ReadVarint(it, end, recordCount)) return false;
+
+            mRecords.clear();
+            mRuns.clear();
+            int64_t x = 0, y = 0;
+            for (uint64_t i = 0; i < recordCount; i++)
+            {
+                uint64_t layer, dx, dy, width, height;
+                if (!ReadVarint(it, end, layer) || !ReadVarint(it, end, dx) || !ReadVarint(it, end, dy)
+                    || !ReadVarint(it, end, width) || !ReadVarint(it, end, height)) return false;
+
+                x += UnZigZag(dx);
+                y += UnZigZag(dy);
+                if (layer >= level.layers.size() || !width || !height || width > TileDeltaEncoder::MaxSide || height > TileDeltaEncoder::MaxSide) return false;
+                if (x < std::numeric_limits<int>::min() || y < std::numeric_limits<int>::min()
+                    || x + static_cast<int64_t>(width) > std::numeric_limits<int>::max() || y + static_cast<int64_t>(height) > std::numeric_limits<int>::max()) return false;
+
+                //A record that doesn't fit a dense layer was made for a different map
+                const Layer& target = level.layers[layer];
+                if (!target.isInfinite() && (x < 0 || y < 0 || x + static_cast<int64_t>(width) > static_cast<int64_t>(target.getWidth())
+                    || y + static_cast<int64_t>(height) > static_cast<int64_t>(target.getHeight()))) return false;
+
+                Record record = { static_cast<size_t>(layer), { static_cast<int>(x), static_cast<int>(y), static_cast<int>(width), static_cast<int>(height) }, mRuns.size() };
+                for (uint64_t covered = 0; covered < width * height;)
+                {
+                    uint64_t run, gid;
+                    if (!ReadVarint(it, end, run) || !ReadVarint(it, end, gid) || !run || run > (width * height) - covered || gid > 0xFFFFFFFF) return false;
+
+                    mRuns.push_back({ static_cast<size_t>(run), static_cast<int>(static_cast<uint32_t>(gid)) });
+                    covered += run;
+                }
+                mRecords.push_back(record);
+            }
+            if (it != end) return false;
+
+            for (size_t i = 0; i < mRecords.size(); i++)
+            {
+                const Record& record = mRecords[i];
+                Layer& layer = level.layers[record.layer];
+                size_t lastRun = i + 1 < mRecords.size() ? mRecords[i + 1].firstRun : mRuns.size();
+
+                int column = 0, row = 0;
+                for (size_t r = record.firstRun; r < lastRun; r++)
+                {
+                    for (size_t n = 0; n < mRuns[r].count; n++)
+                    {
+                        layer.setTile(record.region.x + column, record.region.y + row, mRuns[r].gid);
+                        if (++column == record.region.w)
+                        {
+                            column = 0;
+                            row++;
+                        }
+                    }
+                }
+            }
+
+            if (tick) *tick = static_cast<uint32_t>(packetTick);
+            return true;
+        }
+
+        bool Apply(Level& level, const std::vector<uint8_t>& packet, uint32_t* tick = nullptr) { return Apply(level, packet.data(), packet.size(), tick); }
+
+    private:
+        struct Record
+        {
+            size_t layer;
+            SDL_Rect region;
+            size_t firstRun;
+        };
+
+        struct Run
+        {
+            size_t count;
+            int gid;
+        };
+
+        std::vector<uint8_t> mBody;
+        std::vector<Record> mRecords;
+        std::vector<Run> mRuns;
+    };
+
+
+    /// 
+    ///  SAVE GAME SNAPSHOTS
+    /// 
+
+    // Tiles of one layer that differ from the level as it was loaded
+    struct LayerSnapshot
+    {
+        size_t layer = 0;
+        bool whole = false;                         // Every tile of a dense layer, rather than blocks
+        int width = 0;                              // Size of a whole layer
+        int height = 0;
+        std::vector<std::pair<int, int>> blocks;    // Block coordinates, Layer::DirtyBlockSize tiles square
+        std::vector<int> tiles;                     // Row-major, the whole layer or one block after another
+    };
+
+    struct LevelSnapshot
+    {
+        std::vector<LayerSnapshot> layers;
+
+        size_t tileBytes() const
+        {
+            size_t bytes = 0;
+            for (const LayerSnapshot& layer : layers)
+                bytes += layer.tiles.size() * sizeof(int);
+            return bytes;
+        }
+    };
+
+    // Copies the tiles of every block edited since the level was loaded. With a pristine copy of the level, blocks
+    // that were edited back to their original tiles are left out. A dense layer with more than half of its blocks
+    // edited is copied whole as one buffer. The cost depends on how much was edited, not on the size of the map.
+    inline LevelSnapshot TakeSnapshot(const Level& level, const Level* pristine = nullptr)
+    {
+        TMXTOSDL_PROFILE_SCOPE("TakeSnapshot");
+        constexpr int BlockSize = Layer::DirtyBlockSize;
+        LevelSnapshot snapshot;
+
+        for (size_t i = 0; i < level.layers.size(); i++)
+        {
+            const Layer& layer = level.layers[i];
+            if (!layer.getModifiedBlockCount()) continue;
+
+            const Layer* original = pristine && i < pristine->layers.size() ? &pristine->layers[i] : nullptr;
+            std::vector<std::pair<int, int>> blocks = layer.getModifiedBlocks();
+            std::sort(blocks.begin(), blocks.end(), [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+                return a.second != b.second ? a.second < b.second : a.first < b.first;
+            });
+
+            if (original)
+            {
+                blocks.erase(std::remove_if(blocks.begin(), blocks.end(), [&](const std::pair<int, int>& block) {
+                    for (int y = block.second * BlockSize; y < (block.second + 1) * BlockSize; y++)
+                    {
+                        for (int x = block.first * BlockSize; x < (block.first + 1) * BlockSize; x++)
+                        {
+                            if (layer.getTile(x, y) != original->getTile(x, y)) return false;
+                        }
+                    }
+                    return true;
+                }), blocks.end());
+            }
+            if (blocks.empty()) continue;
+
+            LayerSnapshot saved;
+            saved.layer = i;
+
+            size_t layerBlocks = ((layer.getWidth() + BlockSize - 1) / BlockSize) * ((layer.getHeight() + BlockSize - 1) / BlockSize);
+            if (!layer.isInfinite() && layer.getWidth() && layer.getHeight() && blocks.size() * 2 > layerBlocks)
+            {
+                saved.whole = true;
+                saved.width = static_cast<int>(layer.getWidth());
+                saved.height = static_cast<int>(layer.getHeight());
+                //Layer data can be shorter than the layer, the missing tiles are 0
+                const size_t count = layer.getWidth() * layer.getHeight();
+                saved.tiles.assign(layer.data(), layer.data() + std::min(layer.size(), count));
+                saved.tiles.resize(count, 0);
+            }
+            else
+            {
+                saved.tiles.reserve(blocks.size() * BlockSize * BlockSize);
+                for (const std::pair<int, int>& block : blocks)
+                {
+                    for (int y = block.second * BlockSize; y < (block.second + 1) * BlockSize; y++)
+                    {
+                        for (int x = block.first * BlockSize; x < (block.first + 1) * BlockSize; x++)
+                            saved.tiles.push_back(layer.getTile(x, y));
+                    }
+                }
+                saved.blocks = std::move(blocks);
+            }
+            snapshot.layers.push_back(std::move(saved));
+        }
+        return snapshot;
+    }
+
+    // FNV-1a, to catch save files that were damaged on disk
+    inline uint32_t SnapshotChecksum(const uint8_t* data, size_t size)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ data[i]) * 16777619u;
+        return hash;
+    }
+
+    // Writes a snapshot as raw tile buffers, in host byte order, compressed with CompressLZ and followed by a checksum.
+    // The file is written next to path and renamed over it once complete, so an interrupted save leaves the previous
+    // one intact.
+    inline bool WriteSnapshot(const LevelSnapshot& snapshot, const std::filesystem::path& path)
+    {
+        TMXTOSDL_PROFILE_SCOPE("WriteSnapshot");
+        std::vector<uint8_t> bytes = { 'T', 'M', 'X', 'S', 1 };
+        WriteVarint(bytes, snapshot.layers.size());
+
+        std::vector<uint8_t> compressed;
+        for (const LayerSnapshot& layer : snapshot.layers)
+        {
+            WriteVarint(bytes, layer.layer);
+            bytes.push_back(layer.whole ? 0 : 1);
+            if (layer.whole)
+            {
+                WriteVarint(bytes, static_cast<uint64_t>(layer.width));
+                WriteVarint(bytes, static_cast<uint64_t>(layer.height));
+            }
+            else
+            {
+                WriteVarint(bytes, layer.blocks.size());
+                std::pair<int, int> previous = { 0, 0 };
+                for (const std::pair<int, int>& block : layer.blocks)
+                {
+                    WriteVarint(bytes, ZigZag(static_cast<int64_t>(block.first) - previous.first));
+                    WriteVarint(bytes, ZigZag(static_cast<int64_t>(block.second) - previous.second));
+                    previous = block;
+                }
+            }
+
+            compressed.clear();
+            CompressLZ(reinterpret_cast<const uint8_t*>(layer.tiles.data()), layer.tiles.size() * sizeof(int), compressed);
+            WriteVarint(bytes, compressed.size());
+            bytes.insert(bytes.end(), compressed.begin(), compressed.end());
+        }
+
+        uint32_t checksum = SnapshotChecksum(bytes.data(), bytes.size());
+        for (int shift = 0; shift < 32; shift += 8)
+            bytes.push_back(static_cast<uint8_t>(checksum >> shift));
+
+        std::filesystem::path temporary = path;
+        temporary += ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+            if (!file)
+            {
+                std::cout << "Could not write save file " << temporary << std::endl;
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        if (error)
+        {
+            std::cout << "Could not replace save file " << path << ": " << error.message() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    inline bool ReadSnapshot(const std::filesystem::path& path, LevelSnapshot& snapshot)
+    {
+        TMXTOSDL_PROFILE_SCOPE("ReadSnapshot");
+        constexpr size_t BlockTiles = Layer::DirtyBlockSize * Layer::DirtyBlockSize;
+        snapshot.layers.clear();
+
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        if (bytes.size() < 9) return false;
+        const uint8_t* it = bytes.data();
+        const uint8_t* end = bytes.data() + bytes.size() - 4;
+        uint32_t checksum = end[0] | (end[1] << 8) | (end[2] << 16) | (static_cast<uint32_t>(end[3]) << 24);
+        if (std::memcmp(it, "TMXS", 4) || it[4] != 1 || checksum != SnapshotChecksum(it, bytes.size() - 4)) return false;
+        it += 5;
+
+        uint64_t layerCount;
+        if (!ReadVarint(it, end, layerCount)) return false;
+
+        std::vector<uint8_t> raw;
+        for (uint64_t i = 0; i < layerCount; i++)
+        {
+            LayerSnapshot layer;
+            uint64_t index, tileCount;
+            if (!ReadVarint(it, end, index) || it == end) return false;
+            layer.layer = static_cast<size_t>(index);
+            layer.whole = *it++ == 0;
+
+            if (layer.whole)
+            {
+                uint64_t width, height;
+                if (!ReadVarint(it, end, width) || !ReadVarint(it, end, height) || width > (1 << 16) || height > (1 << 16)) return false;
+                layer.width = static_cast<int>(width);
+                layer.height = static_cast<int>(height);
+                tileCount = width * height;
+            }
+            else
+            {
+                uint64_t blockCount;
+                if (!ReadVarint(it, end, blockCount) || blockCount > static_cast<uint64_t>(end - it)) return false;
+
+                std::pair<int64_t, int64_t> block = { 0, 0 };
+                for (uint64_t b = 0; b < blockCount; b++)
+                {
+                    uint64_t dx, dy;
+                    if (!ReadVarint(it, end, dx) || !ReadVarint(it, end, dy)) return false;
+                    block.first += UnZigZag(dx);
+                    block.second += UnZigZag(dy);
+                    if (std::abs(block.first) > (1 << 26) || std::abs(block.second) > (1 << 26)) return false;
+                    layer.blocks.emplace_back(static_cast<int>(block.first), static_cast<int>(block.second));
+                }
+                tileCount = blockCount * BlockTiles;
+            }
+
+            //The claimed size must be reachable from the bytes actually in the file before any of it is allocated
+            uint64_t compressedSize;
+            if (!ReadVarint(it, end, compressedSize) || compressedSize > static_cast<uint64_t>(end - it)) return false;
+            if (tileCount * sizeof(int) > compressedSize * MaxLZExpansion) return false;
+            if (!DecompressLZ(it, static_cast<size_t>(compressedSize), raw, static_cast<size_t>(tileCount * sizeof(int))) || raw.size() != tileCount * sizeof(int)) return false;
+            it += compressedSize;
+
+            layer.tiles.resize(static_cast<size_t>(tileCount));
+            if (tileCount) std::memcpy(layer.tiles.data(), raw.data(), raw.size());
+            snapshot.layers.push_back(std::move(layer));
+        }
+        return it == end;
+    }
+
+    // Writes the snapshot's tiles into a level loaded from the same map. The edits are recorded like any other, so
+    // subscribers update and a later snapshot includes them. Returns false, changing nothing, if the snapshot
+    // doesn't fit the level.
+    inline bool ApplySnapshot(Level& level, const LevelSnapshot& snapshot)
+    {
+        TMXTOSDL_PROFILE_SCOPE("ApplySnapshot");
+        constexpr int BlockSize = Layer::DirtyBlockSize;
+        for (const LayerSnapshot& saved : snapshot.layers)
+        {
+            if (saved.layer >= level.layers.size()) return false;
+
+            const Layer& layer = level.layers[saved.layer];
+            if (saved.whole && (layer.isInfinite() || layer.getWidth() != static_cast<size_t>(saved.width) || layer.getHeight() != static_cast<size_t>(saved.height))) return false;
+            if (!saved.whole && saved.tiles.size() != saved.blocks.size() * BlockSize * BlockSize) return false;
+            if (saved.whole || layer.isInfinite()) continue;
+
+            //Blocks on the right and bottom edges may hang over, but each must start inside a dense layer
+            for (const std::pair<int, int>& block : saved.blocks)
+            {
+                if (block.first < 0 || block.second < 0 || static_cast<size_t>(block.first) * BlockSize >= layer.getWidth()
+                    || static_cast<size_t>(block.second) * BlockSize >= layer.getHeight()) return false;
+            }
+        }
+
+        for (const LayerSnapshot& saved : snapshot.layers)
+        {
+            Layer& layer = level.layers[saved.layer];
+            if (saved.whole)
+            {
+                layer.setTiles({ 0, 0, saved.width, saved.height }, saved.tiles.data());
+                continue;
+            }
+
+            for (size_t b = 0; b < saved.blocks.size(); b++)
+            {
+                SDL_Rect region = { saved.blocks[b].first * BlockSize, saved.blocks[b].second * BlockSize, BlockSize, BlockSize };
+                layer.setTiles(region, saved.tiles.data() + (b * BlockSize * BlockSize));
+            }
+        }
+        return true;
+    }
 
-        return { x, y, tileset->tilesetWidth, tileset->tileHeight };
+    inline bool RestoreSnapshot(Level& level, const std::filesystem::path& path)
+    {
+        LevelSnapshot snapshot;
+        return ReadSnapshot(path, snapshot) && ApplySnapshot(level, snapshot);
     }
+
+    // Saves levels without stalling the game. Save copies the edited tiles on the calling thread, which only takes as
+    // long as there are edits to copy, and compresses and writes them on the writer's own thread. Saves are written
+    // one at a time in the order they were started. A pristine copy of the level, if given, must outlive the writer.
+    class SnapshotWriter
+    {
+    public:
+        explicit SnapshotWriter(const Level* pristine = nullptr) : mPristine(pristine), mPool(1) {}
+
+        // The future is true once the save is safely on disk
+        std::future<bool> Save(const Level& level, const std::filesystem::path& path)
+        {
+            TMXTOSDL_PROFILE_SCOPE("SnapshotWriter::Save");
+            auto start = std::chrono::steady_clock::now();
+            auto snapshot = std::make_shared<LevelSnapshot>(TakeSnapshot(level, mPristine));
+            mLastSnapshotSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            return mPool.Enqueue([snapshot, path]() { return WriteSnapshot(*snapshot, path); });
+        }
+
+        // Time the last Save spent on the calling thread
+        double GetLastSnapshotSeconds() const { return mLastSnapshotSeconds; }
+
+    private:
+        const Level* mPristine;
+        double mLastSnapshotSeconds = 0.0;
+        ThreadPool mPool;
+    };
 }
+
@@ -0,0 +1,228 @@
+// Tile edit replication benchmark. A server level is edited every tick, its changes are encoded with
+// TileDeltaEncoder, passed through an in-process loopback queue and applied to a client level with
+// TileDeltaDecoder. Reports bytes per tick against sending every edit as a (layer, x, y, gid) tuple, the
+// encode and decode times, and checks that the client ends up identical to the server.
+//
+// Usage: DeltaBenchmark [--ticks N] [--size N]
+
+#define SDL_MAIN_HANDLED
+#include "TMXtoSDL.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace TMXtoSDL;
+
+namespace
+{
+    // Same generator as LevelBenchmark, so runs are repeatable
+    class Random
+    {
+    public:
+        explicit Random(uint32_t seed) : mState(seed) {}
+
+        uint32_t Next()
+        {
+            mState ^= mState << 13;
+            mState ^= mState >> 17;
+            mState ^= mState << 5;
+            return mState;
+        }
+
+        int Range(int count) { return static_cast<int>(Next() % static_cast<uint32_t>(count)); }
+
+    private:
+        uint32_t mState;
+    };
+
+    // Stands in for a network connection: packets sent on one tick arrive on the next
+    class Loopback
+    {
+    public:
+        void Send(const std::vector<uint8_t>& packet) { mInFlight.push_back(packet); }
+
+        bool Receive(std::vector<uint8_t>& packet)
+        {
+            if (mInFlight.empty()) return false;
+
+            packet = std::move(mInFlight.front());
+            mInFlight.pop_front();
+            return true;
+        }
+
+    private:
+        std::deque<std::vector<uint8_t>> mInFlight;
+    };
+
+    enum class Workload
+    {
+        Explosions,     // A few craters a tick, sent as dirty regions
+        BigBlast,       // One large crater a tick, sent as dirty regions
+        Scattered       // Many unrelated single tiles a tick, sent one by one
+    };
+
+    struct CaseResult
+    {
+        const char* name;
+        size_t edits = 0;
+        size_t packetBytes = 0;
+        double encodeSeconds = 0.0;
+        double decodeSeconds = 0.0;
+        bool identical = false;
+    };
+
+    constexpr int LayerCount = 3;
+    constexpr size_t TupleBytes = 4 * sizeof(int32_t);
+
+    // Ground, walls and decoration, with the walls in long horizontal runs as maps usually have them
+    void FillLevel(Level& level, int size)
+    {
+        Random random(7);
+        for (int l = 0; l < LayerCount; l++)
+        {
+            level.layers.emplace_back(static_cast<size_t>(size), static_cast<size_t>(size));
+            Layer& layer = level.layers.back();
+            for (int y = 0; y < size; y++)
+            {
+                for (int x = 0; x < size; x++)
+                {
+                    if (l == 0) layer.push_back(1 + ((x / 8 + y / 8) % 4));
+                    else if (l == 1) layer.push_back((y % 12) < 2 && (x % 40) < 30 ? 17 : 0);
+                    else layer.push_back(random.Range(20) == 0 ? 33 + random.Range(8) : 0);
+                }
+            }
+        }
+    }
+
+    // Clears a crater from the walls and decoration and scorches the ground under it. Returns the tiles that changed.
+    size_t Crater(Level& level, int centreX, int centreY, int radius)
+    {
+        size_t edits = 0;
+        for (int y = centreY - radius; y <= centreY + radius; y++)
+        {
+            for (int x = centreX - radius; x <= centreX + radius; x++)
+            {
+                if (((x - centreX) * (x - centreX)) + ((y - centreY) * (y - centreY)) > radius * radius) continue;
+
+                const int values[LayerCount] = { 9, 0, 0 };
+                for (int l = 0; l < LayerCount; l++)
+                {
+                    if (level.layers[l].getTile(x, y) == values[l]) continue;
+                    if (level.layers[l].setTile(x, y, values[l])) edits++;
+                }
+            }
+        }
+        return edits;
+    }
+
+    CaseResult RunCase(const char* name, Workload workload, int size, int ticks)
+    {
+        CaseResult result;
+        result.name = name;
+
+        Level server, client;
+        FillLevel(server, size);
+        FillLevel(client, size);
+
+        TileDeltaEncoder encoder;
+        TileDeltaDecoder decoder;
+        Loopback loopback;
+        Random random(11);
+        std::vector<uint8_t> packet;
+
+        for (int tick = 0; tick <= ticks; tick++)
+        {
+            //Deliver last tick's packet first, as a client would
+            while (loopback.Receive(packet))
+            {
+                auto start = std::chrono::steady_clock::now();
+                if (!decoder.Apply(client, packet)) std::printf("%s: tick %d packet rejected\n", name, tick);
+                result.decodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            if (tick == ticks) break;
+
+            auto start = std::chrono::steady_clock::now();
+            if (workload == Workload::Scattered)
+            {
+                for (int i = 0; i < 256; i++)
+                {
+                    size_t layer = static_cast<size_t>(random.Range(LayerCount));
+                    int x = random.Range(size), y = random.Range(size), gid = random.Range(48);
+                    if (server.layers[layer].getTile(x, y) == gid) continue;
+
+                    server.layers[layer].setTile(x, y, gid);
+                    encoder.AddTile(layer, x, y, gid);
+                    result.edits++;
+                }
+            }
+            else
+            {
+                int craters = workload == Workload::Explosions ? 4 : 1;
+                int radius = workload == Workload::Explosions ? 6 : 40;
+                for (int i = 0; i < craters; i++)
+                    result.edits += Crater(server, random.Range(size), random.Range(size), radius);
+
+                for (size_t layer = 0; layer < server.layers.size(); layer++)
+                {
+                    for (const SDL_Rect& region : server.layers[layer].takeDirtyRegions())
+                        encoder.AddRegion(server, layer, region);
+                }
+            }
+
+            encoder.EncodeTick(static_cast<uint32_t>(tick), packet);
+            result.encodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            result.packetBytes += packet.size();
+            loopback.Send(packet);
+        }
+
+        result.identical = true;
+        for (size_t layer = 0; layer < server.layers.size() && result.identical; layer++)
+        {
+            for (int y = 0; y < size && result.identical; y++)
+            {
+                for (int x = 0; x < size; x++)
+                {
+                    if (server.layers[layer].getTile(x, y) != client.layers[layer].getTile(x, y))
+                    {
+                        result.identical = false;
+                        break;
+                    }
+                }
+            }
+        }
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int ticks = 600;
+    int size = 512;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "--ticks") && i + 1 < argc) ticks = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--size") && i + 1 < argc) size = std::max(64, std::atoi(argv[++i]));
+        else
+        {
+            std::printf("Usage: %s [--ticks N] [--size N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::printf("%-12s %10s %12s %12s %8s %12s %12s %10s\n", "case", "edits", "tuple B/tick", "packet B/tick", "ratio", "encode us", "decode us", "round trip");
+    const std::pair<const char*, Workload> workloads[] = {
+        { "explosions", Workload::Explosions },
+        { "big blast", Workload::BigBlast },
+        { "scattered", Workload::Scattered }
+    };
+    for (const auto& workload : workloads)
+    {
+        CaseResult result = RunCase(workload.first, workload.second, size, ticks);
+        double tupleBytes = static_cast<double>(result.edits * TupleBytes) / ticks;
+        double packetBytes = static_cast<double>(result.packetBytes) / ticks;
+        std::printf("%-12s %10zu %12.0f %12.0f %7.1fx %12.1f %12.1f %10s\n", result.name, result.edits, tupleBytes, packetBytes,
+            tupleBytes / packetBytes, result.encodeSeconds * 1e6 / ticks, result.decodeSeconds * 1e6 / ticks, result.identical ? "ok" : "FAILED");
+    }
+    return 0;
+}
@@ -0,0 +1,413 @@
+// Level loading benchmark. Generates synthetic .tmx/.tsx/.png fixtures and times IO::OpenLevel stage by stage.
+// Also compares reading and parsing each map with a fresh document and parse<0> against a reused XmlDocument,
+// and loads every fixture again in one Loader::OpenLevels batch to report the parallel speedup.
+//
+// Usage: LevelBenchmark [--fixtures DIR] [--json FILE] [--iterations N] [--full]
+
+#define SDL_MAIN_HANDLED
+#include "TMXtoSDL.hpp"
+#include "rapidxml/rapidxml_utils.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace TMXtoSDL;
+
+namespace
+{
+    struct FixtureConfig
+    {
+        std::string name;
+        int width;
+        int height;
+        int layers;
+        int tilesets;
+        float colliderDensity;  // Fraction of tiles in each tileset with a collider
+        LayerEncoding encoding;
+        int objects;
+    };
+
+    struct CaseResult
+    {
+        FixtureConfig config;
+        int iterations;
+        LoadStats median;
+
+        // Reading and parsing the .tmx only
+        double freshParseSeconds;       // rapidxml::file and a new document parsed with parse<0>, as before XmlDocument
+        double reusedParseSeconds;      // XmlDocument reused between iterations with XmlParseFlags
+    };
+
+    constexpr int TileSize = 16;
+    constexpr int TilesetColumns = 16;
+    constexpr int TilesPerSet = TilesetColumns * TilesetColumns;
+
+    // Small deterministic generator so fixtures are identical between runs and versions
+    class Random
+    {
+    public:
+        explicit Random(uint32_t seed) : mState(seed) {}
+
+        uint32_t Next()
+        {
+            mState ^= mState << 13;
+            mState ^= mState >> 17;
+            mState ^= mState << 5;
+            return mState;
+        }
+
+        float NextFloat() { return static_cast<float>(Next() & 0xFFFFFF) / static_cast<float>(0x1000000); }
+
+    private:
+        uint32_t mState;
+    };
+
+    void AppendBase64(std::string& out, const std::vector<uint8_t>& bytes)
+    {
+        const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        size_t i = 0;
+        for (; i + 2 < bytes.size(); i += 3)
+        {
+            uint32_t triple = (bytes[i] << 16) | (bytes[i + 1] << 8) | bytes[i + 2];
+            out.push_back(alphabet[(triple >> 18) & 0x3F]);
+            out.push_back(alphabet[(triple >> 12) & 0x3F]);
+            out.push_back(alphabet[(triple >> 6) & 0x3F]);
+            out.push_back(alphabet[triple & 0x3F]);
+        }
+
+        if (i < bytes.size())
+        {
+            uint32_t triple = bytes[i] << 16;
+            if (i + 1 < bytes.size()) triple |= bytes[i + 1] << 8;
+
+            out.push_back(alphabet[(triple >> 18) & 0x3F]);
+            out.push_back(alphabet[(triple >> 12) & 0x3F]);
+            out.push_back(i + 1 < bytes.size() ? alphabet[(triple >> 6) & 0x3F] : '=');
+            out.push_back('=');
+        }
+    }
+
+    bool WriteFile(const std::filesystem::path& path, const std::string& contents)
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        return static_cast<bool>(file);
+    }
+
+    bool WriteTileset(const std::filesystem::path& dir, int index, float colliderDensity, Random& random)
+    {
+        std::string name = "tileset" + std::to_string(index);
+
+        SDL_Surface* image = SDL_CreateRGBSurfaceWithFormat(0, TilesetColumns * TileSize, TilesetColumns * TileSize, 32, SDL_PIXELFORMAT_ARGB8888);
+        if (!image) return false;
+
+        Uint32* pixels = static_cast<Uint32*>(image->pixels);
+        for (int i = 0; i < image->w * image->h; i++)
+            pixels[i] = 0xFF000000u | (random.Next() & 0xFFFFFF);
+
+        bool saved = IMG_SavePNG(image, (dir / (name + ".png")).string().c_str()) == 0;
+        SDL_FreeSurface(image);
+        if (!saved) return false;
+
+        std::string tsx;
+        tsx += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+        tsx += "<tileset version=\"1.9\" name=\"" + name + "\" tilewidth=\"16\" tileheight=\"16\" tilecount=\"256\" columns=\"16\">\n";
+        tsx += " <image source=\"" + name + ".png\" width=\"256\" height=\"256\"/>\n";
+
+        for (int tile = 0; tile < TilesPerSet; tile++)
+        {
+            if (random.NextFloat() >= colliderDensity) continue;
+
+            tsx += " <tile id=\"" + std::to_string(tile) + "\">\n";
+            tsx += "  <objectgroup draworder=\"index\" id=\"2\">\n";
+            tsx += "   <object id=\"1\" x=\"0\" y=\"0\" width=\"16\" height=\"8\"/>\n";
+            tsx += "   <object id=\"2\" x=\"4\" y=\"8\" width=\"8\" height=\"8\"/>\n";
+            tsx += "  </objectgroup>\n";
+            tsx += " </tile>\n";
+        }
+        tsx += "</tileset>\n";
+
+        return WriteFile(dir / (name + ".tsx"), tsx);
+    }
+
+    // Writes DIR/<name>/<name>.tmx plus its tilesets, laid out the way IO::OpenLevel expects
+    bool GenerateFixture(const std::filesystem::path& root, const FixtureConfig& config)
+    {
+        std::filesystem::path dir = root / config.name;
+        std::filesystem::create_directories(dir);
+
+        Random random(0x9E3779B9u ^ static_cast<uint32_t>(config.width * 31 + config.layers * 7 + config.tilesets));
+
+        for (int i = 0; i < config.tilesets; i++)
+        {
+            if (!WriteTileset(dir, i, config.colliderDensity, random)) return false;
+        }
+
+        std::string tmx;
+        tmx.reserve(static_cast<size_t>(config.width) * config.height * config.layers * 5);
+        tmx += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+        tmx += "<map version=\"1.9\" orientation=\"orthogonal\" renderorder=\"right-down\" width=\"" + std::to_string(config.width) +
+            "\" height=\"" + std::to_string(config.height) + "\" tilewidth=\"16\" tileheight=\"16\" infinite=\"0\">\n";
+
+        for (int i = 0; i < config.tilesets; i++)
+            tmx += " <tileset firstgid=\"" + std::to_string(1 + i * TilesPerSet) + "\" source=\"tileset" + std::to_string(i) + ".tsx\"/>\n";
+
+        const uint32_t gidCount = static_cast<uint32_t>(config.tilesets * TilesPerSet);
+        for (int layer = 0; layer < config.layers; layer++)
+        {
+            tmx += " <layer id=\"" + std::to_string(layer + 1) + "\" name=\"layer" + std::to_string(layer) + "\" width=\"" +
+                std::to_string(config.width) + "\" height=\"" + std::to_string(config.height) + "\">\n";
+
+            if (config.encoding == LayerEncoding::CSV)
+            {
+                tmx += "  <data encoding=\"csv\">\n";
+                for (int y = 0; y < config.height; y++)
+                {
+                    for (int x = 0; x < config.width; x++)
+                    {
+                        // Roughly a quarter of the cells are empty
+                        uint32_t roll = random.Next();
+                        tmx += std::to_string((roll & 3) == 0 ? 0 : 1 + ((roll >> 2) % gidCount));
+                        if (x + 1 < config.width || y + 1 < config.height) tmx += ',';
+                    }
+                    tmx += '\n';
+                }
+            }
+            else
+            {
+                std::vector<uint8_t> bytes;
+                bytes.reserve(static_cast<size_t>(config.width) * config.height * 4);
+                for (int i = 0; i < config.width * config.height; i++)
+                {
+                    uint32_t roll = random.Next();
+                    uint32_t gid = (roll & 3) == 0 ? 0 : 1 + ((roll >> 2) % gidCount);
+                    for (int b = 0; b < 4; b++)
+                        bytes.push_back(static_cast<uint8_t>(gid >> (8 * b)));
+                }
+
+                tmx += "  <data encoding=\"base64\">\n   ";
+                AppendBase64(tmx, bytes);
+                tmx += '\n';
+            }
+            tmx += "  </data>\n </layer>\n";
+        }
+
+        tmx += " <objectgroup id=\"" + std::to_string(config.layers + 1) + "\" name=\"objects\">\n";
+        for (int i = 0; i < config.objects; i++)
+        {
+            tmx += "  <object id=\"" + std::to_string(i + 1) + "\" type=\"spawner\" x=\"" + std::to_string(random.Next() % (config.width * TileSize)) +
+                "\" y=\"" + std::to_string(random.Next() % (config.height * TileSize)) + "\" width=\"16\" height=\"16\">\n";
+            tmx += "   <properties>\n    <property name=\"count\" type=\"int\" value=\"" + std::to_string(random.Next() % 10) + "\"/>\n   </properties>\n";
+            tmx += "  </object>\n";
+        }
+        tmx += " </objectgroup>\n";
+        tmx += "</map>\n";
+
+        return WriteFile(dir / (config.name + ".tmx"), tmx);
+    }
+
+    std::vector<FixtureConfig> GetConfigs(bool full)
+    {
+        // Each case varies one dimension from the 256x256 baseline
+        std::vector<FixtureConfig> configs = {
+            { "baseline", 256, 256, 2, 2, 0.1f, LayerEncoding::CSV, 100 },
+            { "size_64", 64, 64, 2, 2, 0.1f, LayerEncoding::CSV, 100 },
+            { "size_1024", 1024, 1024, 2, 2, 0.1f, LayerEncoding::CSV, 100 },
+            { "layers_8", 256, 256, 8, 2, 0.1f, LayerEncoding::CSV, 100 },
+            { "tilesets_16", 256, 256, 2, 16, 0.1f, LayerEncoding::CSV, 100 },
+            { "colliders_0", 256, 256, 2, 2, 0.0f, LayerEncoding::CSV, 100 },
+            { "colliders_100", 256, 256, 2, 2, 1.0f, LayerEncoding::CSV, 100 },
+            { "objects_10000", 256, 256, 2, 2, 0.1f, LayerEncoding::CSV, 10000 },
+            { "base64", 256, 256, 2, 2, 0.1f, LayerEncoding::Base64, 100 },
+            { "base64_1024", 1024, 1024, 2, 2, 0.1f, LayerEncoding::Base64, 100 },
+        };
+
+        if (full)
+        {
+            configs.push_back({ "size_4096", 4096, 4096, 2, 2, 0.1f, LayerEncoding::CSV, 100 });
+            configs.push_back({ "layers_32", 512, 512, 32, 4, 0.1f, LayerEncoding::CSV, 100 });
+            configs.push_back({ "tilesets_64", 256, 256, 2, 64, 0.25f, LayerEncoding::CSV, 100 });
+        }
+        return configs;
+    }
+
+    double Median(std::vector<double> values)
+    {
+        std::sort(values.begin(), values.end());
+        return values[values.size() / 2];
+    }
+
+    LoadStats MedianStats(const std::vector<LoadStats>& runs)
+    {
+        auto median = [&runs](double LoadStats::* field) {
+            std::vector<double> values;
+            for (const LoadStats& run : runs) values.push_back(run.*field);
+            return Median(values);
+        };
+
+        LoadStats result = runs.front();
+        result.readSeconds = median(&LoadStats::readSeconds);
+        result.parseSeconds = median(&LoadStats::parseSeconds);
+        result.layerSeconds = median(&LoadStats::layerSeconds);
+        result.tilesetSeconds = median(&LoadStats::tilesetSeconds);
+        result.imageSeconds = median(&LoadStats::imageSeconds);
+        result.objectSeconds = median(&LoadStats::objectSeconds);
+        result.totalSeconds = median(&LoadStats::totalSeconds);
+        return result;
+    }
+
+    // Median times to read and parse a map, first the way loads used to, then with a reused XmlDocument
+    std::pair<double, double> MeasureXmlParse(const std::filesystem::path& tmxPath, int iterations)
+    {
+        std::vector<double> fresh, reused;
+        for (int i = 0; i < iterations; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            {
+                rapidxml::file<> xmlFile(tmxPath.string().c_str());
+                rapidxml::xml_document<>* doc = new rapidxml::xml_document<>;
+                doc->parse<0>(xmlFile.data());
+                delete doc;
+            }
+            auto middle = std::chrono::steady_clock::now();
+            {
+                XmlDocument doc;
+                doc.Read(tmxPath);
+                doc.Parse();
+            }
+            auto end = std::chrono::steady_clock::now();
+
+            fresh.push_back(std::chrono::duration<double>(middle - start).count());
+            reused.push_back(std::chrono::duration<double>(end - middle).count());
+        }
+        return { Median(fresh), Median(reused) };
+    }
+
+    const char* EncodingName(LayerEncoding encoding) { return encoding == LayerEncoding::Base64 ? "base64" : "csv"; }
+
+    void WriteJson(const std::filesystem::path& path, const std::vector<CaseResult>& results)
+    {
+        std::ofstream file(path);
+        file << "{\n  \"version\": 1,\n  \"cases\": [\n";
+
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const FixtureConfig& config = results[i].config;
+            const LoadStats& stats = results[i].median;
+
+            file << "    {\n";
+            file << "      \"name\": \"" << config.name << "\",\n";
+            file << "      \"width\": " << config.width << ", \"height\": " << config.height << ", \"layers\": " << config.layers
+                << ", \"tilesets\": " << config.tilesets << ", \"colliderDensity\": " << config.colliderDensity
+                << ", \"encoding\": \"" << EncodingName(config.encoding) << "\", \"objects\": " << config.objects << ",\n";
+            file << "      \"iterations\": " << results[i].iterations << ",\n";
+            file << "      \"fileBytes\": " << stats.fileBytes << ", \"tiles\": " << stats.tileCount << ",\n";
+            file << "      \"parseBytes\": " << stats.parseBytes << ", \"peakBytes\": " << stats.peakBytes << ",\n";
+            file << "      \"seconds\": { \"total\": " << stats.totalSeconds << ", \"read\": " << stats.readSeconds << ", \"parse\": " << stats.parseSeconds
+                << ", \"layers\": " << stats.layerSeconds << ", \"tilesets\": " << stats.tilesetSeconds << ", \"images\": " << stats.imageSeconds
+                << ", \"objects\": " << stats.objectSeconds << " },\n";
+            file << "      \"xmlParseSeconds\": { \"fresh\": " << results[i].freshParseSeconds << ", \"reused\": " << results[i].reusedParseSeconds << " },\n";
+            file << "      \"tilesPerSecond\": " << stats.tileCount / stats.totalSeconds << ",\n";
+            file << "      \"megabytesPerSecond\": " << (stats.fileBytes / (1024.0 * 1024.0)) / stats.totalSeconds << "\n";
+            file << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+
+        file << "  ]\n}\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::filesystem::path fixtureRoot = std::filesystem::temp_directory_path() / "tmxtosdl_benchmark";
+    std::filesystem::path jsonPath;
+    int iterations = 5;
+    bool full = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "--fixtures") && i + 1 < argc) fixtureRoot = argv[++i];
+        else if (!std::strcmp(argv[i], "--json") && i + 1 < argc) jsonPath = argv[++i];
+        else if (!std::strcmp(argv[i], "--iterations") && i + 1 < argc) iterations = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--full")) full = true;
+        else
+        {
+            std::printf("Usage: %s [--fixtures DIR] [--json FILE] [--iterations N] [--full]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    SDL_SetMainReady();
+
+    // A software renderer needs no window, so the benchmark runs headless
+    SDL_Surface* target = SDL_CreateRGBSurfaceWithFormat(0, 1, 1, 32, SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer* renderer = target ? SDL_CreateSoftwareRenderer(target) : nullptr;
+    if (!renderer)
+    {
+        std::printf("Could not create renderer: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    std::vector<CaseResult> results;
+
+    std::printf("%-16s %10s %10s %8s %8s %8s %8s %8s %8s %12s %8s\n", "case", "tiles", "KiB", "total ms", "read", "parse", "layers", "tilesets", "images", "tiles/s", "MB/s");
+    for (const FixtureConfig& config : GetConfigs(full))
+    {
+        if (!GenerateFixture(fixtureRoot, config))
+        {
+            std::printf("%-16s could not write fixture: %s\n", config.name.c_str(), SDL_GetError());
+            continue;
+        }
+
+        std::filesystem::path lvlPath = fixtureRoot / config.name / "";
+        std::vector<LoadStats> runs;
+        for (int i = 0; i < iterations; i++)
+        {
+            Level level;
+            IO::OpenLevel(lvlPath, level, renderer);
+            runs.push_back(level.stats);
+            Image::DestroyTilesets(level.tilesets);
+        }
+
+        LoadStats stats = MedianStats(runs);
+        auto [freshParse, reusedParse] = MeasureXmlParse(fixtureRoot / config.name / (config.name + ".tmx"), iterations);
+        results.push_back({ config, iterations, stats, freshParse, reusedParse });
+
+        std::printf("%-16s %10zu %10zu %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %12.0f %8.1f\n", config.name.c_str(), stats.tileCount, stats.fileBytes / 1024,
+            stats.totalSeconds * 1000.0, stats.readSeconds * 1000.0, stats.parseSeconds * 1000.0, stats.layerSeconds * 1000.0,
+            stats.tilesetSeconds * 1000.0, stats.imageSeconds * 1000.0, stats.tileCount / stats.totalSeconds,
+            (stats.fileBytes / (1024.0 * 1024.0)) / stats.totalSeconds);
+    }
+
+    std::printf("\n%-16s %14s %14s %8s\n", "xml read+parse", "parse<0> ms", "reused ms", "speedup");
+    for (const CaseResult& result : results)
+    {
+        std::printf("%-16s %14.3f %14.3f %7.2fx\n", result.config.name.c_str(), result.freshParseSeconds * 1000.0,
+            result.reusedParseSeconds * 1000.0, result.freshParseSeconds / result.reusedParseSeconds);
+    }
+
+    // Every fixture loaded iterations times in one batch, as a server warming up its levels would
+    std::vector<std::filesystem::path> batchPaths;
+    for (int i = 0; i < iterations; i++)
+    {
+        for (const CaseResult& result : results)
+            batchPaths.push_back(fixtureRoot / result.config.name / "");
+    }
+
+    Loader loader(renderer);
+    BatchResult batch = loader.OpenLevels(batchPaths);
+    std::printf("\n%-16s %8s %8s %10s %10s %8s\n", "batch", "levels", "failed", "wall ms", "work ms", "speedup");
+    std::printf("%-16s %8zu %8zu %10.2f %10.2f %7.2fx\n", "all cases", batch.levels.size(), batch.failedCount(),
+        batch.wallSeconds * 1000.0, batch.workSeconds * 1000.0, batch.speedup());
+    for (LevelResult& result : batch.levels)
+    {
+        if (result.level) Image::DestroyTilesets(result.level->tilesets);
+    }
+
+    if (!jsonPath.empty())
+        WriteJson(jsonPath, results);
+
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(target);
+    return 0;
+}